@@ -1,5 +1,8 @@
 #include "Client.h"
 #include "DataIO.h"
+#include "DatagramIO.h"
+#include "Frame.h"
+#include "Heartbeat.h"
 
 #include <boost/asio.hpp>
 
@@ -14,39 +17,59 @@ namespace network {
 class Client::Impl
 {
     using Connection = boost::signals2::connection;
-    using SocketPtr  = std::shared_ptr<boost::asio::ip::tcp::socket>;
+    using Socket     = boost::asio::generic::stream_protocol::socket;
+    using SocketPtr  = std::shared_ptr<Socket>;
+    using Endpoint   = boost::asio::generic::stream_protocol::endpoint;
 
 public:
 
-    Impl(Client* parent, unsigned port, std::string ip);
+    Impl(Client* parent, const ClientConfig& config);
     ~Impl();
 
+    void resolve(unsigned port, std::string ip);
+    void connect(const Endpoint& endpoint);
+
     void send(const std::string&);
+    auto sendUnreliable(const std::string&) -> bool;
     void poll()                                  { _ioService.poll_one(); }
     auto connectionState() const -> ConnectionState { return _state;     }
+    auto queuedBytes()     const -> size_t       { return _dataIO.queuedBytes(_socket); }
 
 private:
 
     void connectionChanged(ConnectionState cs) { return _parent->_connectionChanged(cs); }
-    void dataReceived(std::string r)           { return _parent->_dataReceived(r);       }
+    void dataReceived(const std::string& r);
     void errorEmitted(std::string e)           { return _parent->_errorEmitted(e);       }
 
     void setState(ConnectionState state);
-    void resolve(unsigned port, std::string ip);
-    void connect(boost::asio::ip::tcp::resolver::iterator&);
+    void armHeartbeat();
+    void armAnnounce();
     void onDataReceived(SocketPtr socket, const std::string& data);
+    void onHeartbeatReceived(SocketPtr socket);
+    void onDatagramTokenReceived(SocketPtr socket, uint64_t token);
+    void onDatagramAckReceived(SocketPtr socket);
+    void onDatagramReceived(uint64_t token, const DatagramIO::Messages& messages);
     void onSocketDisconnected(SocketPtr socket);
     void socketError();
     void closeSocket();
 
     Client*         _parent;
+    ClientConfig    _config;
     DataIO          _dataIO;
     ConnectionState _state;
 
     boost::asio::io_service        _ioService;
     boost::asio::ip::tcp::resolver _resolver;
+    boost::asio::steady_timer      _heartbeatTimer;
     SocketPtr                      _socket;
     int                            _errorCount;
+    Heartbeat                      _heartbeat;
+
+    DatagramIO                     _datagramIO;
+    DatagramIO::Endpoint           _datagramServer;
+    uint64_t                       _datagramToken;
+    bool                           _datagramAcked;
+    boost::asio::steady_timer      _announceTimer;
 };
 
 
@@ -54,17 +77,32 @@ private:
 //--- Implementation
 //------------------------------------------------------------------------------
 
-Client::Impl::Impl(Client* parent, unsigned port, std::string ip)
+Client::Impl::Impl(Client* parent, const ClientConfig& config)
 : _parent(parent)
+, _config(config)
+, _state(STATE_OFF)
 , _resolver(_ioService)
+, _heartbeatTimer(_ioService)
+, _errorCount(0)
+, _heartbeat(&_config.heartbeat)
+, _datagramIO(_ioService)
+, _datagramToken(0)
+, _datagramAcked(false)
+, _announceTimer(_ioService)
 {
-    _dataIO.connectSocketDisconnect([this](SocketPtr socket)                { onSocketDisconnected(socket); });
-    _dataIO.connectDataReceived([this](SocketPtr socket, std::string data)  { onDataReceived(socket, data);  });
-    _dataIO.connectErrorEmitted([this](SocketPtr, std::string error) { ++_errorCount; errorEmitted(error); });
-
-    _socket = std::make_shared<boost::asio::ip::tcp::socket>(_ioService);
-
-    resolve(port, ip);
+    _dataIO.setSocketDisconnectHandler([this](SocketPtr socket)                      { onSocketDisconnected(socket); });
+    _dataIO.setDataReceivedHandler([this](SocketPtr socket, std::string data)        { onDataReceived(socket, data);  });
+    _dataIO.setHeartbeatReceivedHandler([this](SocketPtr socket)                     { onHeartbeatReceived(socket);   });
+    _dataIO.setDatagramTokenReceivedHandler([this](SocketPtr socket, uint64_t token) { onDatagramTokenReceived(socket, token); });
+    _dataIO.setDatagramAckReceivedHandler([this](SocketPtr socket)                   { onDatagramAckReceived(socket); });
+    _dataIO.setReceiveProgressHandler([this](SocketPtr)                              { _heartbeat.frameReceived(false); });
+    _dataIO.setErrorEmittedHandler([this](SocketPtr, std::string error) { ++_errorCount; errorEmitted(error); });
+
+    _datagramIO.setDataReceivedHandler([this](const DatagramIO::Endpoint&, uint64_t token, const DatagramIO::Messages& messages)
+                                    { onDatagramReceived(token, messages); });
+    _datagramIO.setErrorEmittedHandler([this](std::string error) { errorEmitted(error); });
+
+    _socket = std::make_shared<Socket>(_ioService);
 }
 
 //------------------------------------------------------------------------------
@@ -72,12 +110,24 @@ Client::Impl::Impl(Client* parent, unsigned port, std::string ip)
 Client::Impl::~Impl()
 {
     _resolver.cancel();
+    _heartbeatTimer.cancel();
+    _announceTimer.cancel();
+    _datagramIO.close();
     closeSocket();
     _ioService.run();
 }
 
 //------------------------------------------------------------------------------
 
+void Client::Impl::dataReceived(const std::string& data)
+{
+    // A plain flag, signal::empty() would lock the signal for every message
+    if (_parent->_dataHandler) _parent->_dataHandler(data);
+    if (_parent->_dataSlots)   _parent->_dataReceived(data);
+}
+
+//------------------------------------------------------------------------------
+
 void Client::Impl::setState(ConnectionState state)
 {
     if (_state != state)
@@ -103,9 +153,9 @@ void Client::Impl::socketError()
 void Client::Impl::closeSocket()
 {
     boost::system::error_code ec;
-    _socket->cancel();
-    _socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
-    _socket->close();
+    _socket->cancel(ec);
+    _socket->shutdown(boost::asio::socket_base::shutdown_both, ec);
+    _socket->close(ec);
 }
 
 //------------------------------------------------------------------------------
@@ -120,27 +170,32 @@ void Client::Impl::resolve(unsigned port, std::string ip)
     _resolver.async_resolve(query, [this](const boost::system::error_code &ec, tcp::resolver::iterator it)
     {
         if (!ec && it != tcp::resolver::iterator()) {
-            connect(it);
+            connect(it->endpoint());
         }
         else {
             errorEmitted("Client: do_resolve failed!");
+            setState(STATE_OFF);
         }
     });
 }
 
 //------------------------------------------------------------------------------
 
-void Client::Impl::connect(boost::asio::ip::tcp::resolver::iterator& it)
+void Client::Impl::connect(const Endpoint& endpoint)
 {
-    using namespace boost::asio::ip;
-    _socket->async_connect(*it, [this,&it](const boost::system::error_code &ec) mutable
+    setState(STATE_CONNECTING);
+
+    _socket->async_connect(endpoint, [this](const boost::system::error_code &ec)
     {
         if (!ec) {
             setState(STATE_CONNECTED);
+            _heartbeat.frameReceived(true);
             _dataIO.listen(_socket);
+            armHeartbeat();
         }
         else {
             errorEmitted("Client: do_connect failed!");
+            setState(STATE_OFF);
         }
     });
 }
@@ -149,20 +204,148 @@ void Client::Impl::connect(boost::asio::ip::tcp::resolver::iterator& it)
 
 void Client::Impl::send(const std::string& data)
 {
+    if (!frame::validDataSize(data.size())) {
+        errorEmitted("Client: invalid message size");
+        return;
+    }
+
     _dataIO.send(_socket, data);
 }
 
 //------------------------------------------------------------------------------
 
+bool Client::Impl::sendUnreliable(const std::string& data)
+{
+    if (_datagramToken == 0)
+        return false;
+
+    _datagramIO.send(_datagramServer, _datagramToken, data);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
 void Client::Impl::onDataReceived(SocketPtr, const std::string& data)
 {
     _errorCount = 0;
+    _heartbeat.frameReceived(true);
     dataReceived(data);
     _dataIO.listen(_socket);
 }
 
 //------------------------------------------------------------------------------
 
+void Client::Impl::onHeartbeatReceived(SocketPtr)
+{
+    _errorCount = 0;
+    _heartbeat.frameReceived(false);
+    _dataIO.listen(_socket);
+}
+
+//------------------------------------------------------------------------------
+
+void Client::Impl::onDatagramTokenReceived(SocketPtr, uint64_t token)
+{
+    // The server's datagram channel uses the address and port of the stream connection
+    boost::system::error_code ec;
+    auto remote = _socket->remote_endpoint(ec);
+
+    DatagramIO::Endpoint server;
+    if (!ec && toDatagramEndpoint(remote, server))
+    {
+        if (!_datagramIO.isOpen())
+        {
+            _datagramIO.open(DatagramIO::Endpoint(server.protocol(), 0));
+            _datagramIO.listen();
+        }
+
+        _datagramIO.removeToken(_datagramToken);
+        _datagramIO.addToken(token);
+        _datagramServer = server;
+        _datagramToken  = token;
+        _datagramAcked  = false;
+        _datagramIO.announce(_datagramServer, _datagramToken);
+        armAnnounce();
+    }
+
+    _dataIO.listen(_socket);
+}
+
+//------------------------------------------------------------------------------
+
+void Client::Impl::onDatagramAckReceived(SocketPtr)
+{
+    _datagramAcked = true;
+    _announceTimer.cancel();
+    _dataIO.listen(_socket);
+}
+
+//------------------------------------------------------------------------------
+
+void Client::Impl::armAnnounce()
+{
+    // Repeat the announcement until the server acknowledged it, a lost
+    // announcement would otherwise keep the server from sending datagrams
+    _announceTimer.expires_from_now(cfg::announceInterval);
+    _announceTimer.async_wait([this](const boost::system::error_code& ec)
+    {
+        if (ec || _datagramAcked || _state != STATE_CONNECTED || !_socket->is_open())
+            return;
+
+        _datagramIO.announce(_datagramServer, _datagramToken);
+        armAnnounce();
+    });
+}
+
+//------------------------------------------------------------------------------
+
+void Client::Impl::onDatagramReceived(uint64_t token, const DatagramIO::Messages& messages)
+{
+    if (token != _datagramToken)
+        return;
+
+    for (auto& m : messages)
+        dataReceived(m);
+}
+
+//------------------------------------------------------------------------------
+
+void Client::Impl::armHeartbeat()
+{
+    if (!_heartbeat.enabled())
+        return;
+
+    _heartbeatTimer.expires_at(_heartbeat.nextDeadline());
+    _heartbeatTimer.async_wait([this](const boost::system::error_code& ec)
+    {
+        // A wait that already expired is not aborted by cancel(), the closed socket
+        // keeps the destructor from re-arming the timer until the read timeout
+        if (ec || _state != STATE_CONNECTED || !_socket->is_open()) 
+            return;
+
+        switch (_heartbeat.check(std::chrono::steady_clock::now()))
+        {
+        case Heartbeat::ACTION_IDLE_TIMEOUT:
+            errorEmitted("Client: server idle timeout");
+            onSocketDisconnected(_socket);
+            return;
+        case Heartbeat::ACTION_READ_TIMEOUT:
+            errorEmitted("Client: server heartbeat timeout");
+            onSocketDisconnected(_socket);
+            return;
+        case Heartbeat::ACTION_PING:
+            _dataIO.ping(_socket);
+            break;
+        case Heartbeat::ACTION_NONE:
+            break;
+        }
+
+        armHeartbeat();
+    });
+}
+
+//------------------------------------------------------------------------------
+
 void Client::Impl::onSocketDisconnected(SocketPtr)
 {
     closeSocket();
@@ -174,18 +357,43 @@ void Client::Impl::onSocketDisconnected(SocketPtr)
 //--- Client
 //------------------------------------------------------------------------------
 
-Client::Client(unsigned port)
+Client::Client(unsigned port, ClientConfig config)
 : _impl(nullptr)
 , _port(port)
+, _config(config)
+, _dataSlots(false)
 {}
 
 Client::~Client() { disconnect(); }
 
-void Client::connect(std::string ip)                    { if (!_impl) _impl.reset(new Impl(this, _port, ip)); }
+void Client::connect(std::string ip)
+{
+    if (_impl) 
+        return;
+
+    _impl.reset(new Impl(this, _config));
+    _impl->resolve(_port, ip);
+}
+
+void Client::connectLocal(std::string path)
+{
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    if (_impl) 
+        return;
+
+    _impl.reset(new Impl(this, _config));
+    _impl->connect(boost::asio::local::stream_protocol::endpoint(path));
+#else
+    _errorEmitted("Client: local sockets are not supported on this platform");
+#endif
+}
+
 void Client::disconnect()                               { _impl.reset(nullptr); }
 
 void Client::send(const std::string& data)              { if (_impl) _impl->send(data); }
+auto Client::sendUnreliable(const std::string& data) -> bool { return _impl ? _impl->sendUnreliable(data) : false; }
 auto Client::connectionState() const -> ConnectionState { return _impl ? _impl->connectionState() : STATE_OFF; }
+auto Client::queuedBytes()     const -> size_t          { return _impl ? _impl->queuedBytes() : 0; }
 void Client::poll()                                  
 { 
     if (_impl && connectionState() == STATE_OFF)   disconnect();
@@ -198,7 +406,10 @@ Client::Connection Client::connectConnectionChanged(const std::function<void(Con
 { return _connectionChanged.connect(handler); }
 
 Client::Connection Client::connectDataReceived(const std::function<void(std::string)> handler) 
-{ return _dataReceived.connect(handler); }
+{ _dataSlots = true; return _dataReceived.connect(handler); }
+
+void Client::setDataReceivedHandler(DataHandler handler)
+{ _dataHandler = std::move(handler); }
 
 Client::Connection Client::connectErrorEmitted(const std::function<void(std::string)> handler)
 { return _errorEmitted.connect(handler); }
@@ -31,27 +31,39 @@ class Client
     using Connection = boost::signals2::connection;
 
 public:
+    using DataHandler = std::function<void(const std::string&)>;
 
-    Client(unsigned port);
+    Client(unsigned port, ClientConfig config = ClientConfig());
     ~Client();
     
     // Run processing loop and execute read handler
     void poll();
 
-    // (Dis-)Connect to a server
+    // (Dis-)Connect to a server, connectLocal uses the unix domain socket of a same-host server
     void connect(std::string ip);
+    void connectLocal(std::string path);
     void disconnect();
 
     auto connectionState() const -> ConnectionState;
+    auto queuedBytes()     const -> size_t; // sent but not yet written to the socket
 
     // Send data to Server
     void send(const std::string& data);
 
+    // Send data over the datagram channel, if the server offers one (see ServerConfig::datagrams).
+    // Messages may be lost and older messages are dropped by the server. Returns false if
+    // the channel is not available (yet), the server sends it shortly after connecting.
+    auto sendUnreliable(const std::string& data) -> bool;
+
     // Callbacks
     Connection connectConnectionChanged(const std::function<void(ConnectionState)>);
     Connection connectDataReceived(const std::function<void(std::string)>);
     Connection connectErrorEmitted(const std::function<void(std::string)>);
 
+    // Fast path for received data: a single handler (replaces the previous one) without
+    // signal dispatch and string copy. Called before the connectDataReceived slots.
+    void setDataReceivedHandler(DataHandler);
+
 
 private:
 
@@ -61,11 +73,14 @@ private:
     class Impl; friend Impl;
     std::unique_ptr<Impl> _impl;
 
-    unsigned _port;
+    unsigned     _port;
+    ClientConfig _config;
 
     boost::signals2::signal<void(ConnectionState)> _connectionChanged;
     boost::signals2::signal<void(std::string)>     _dataReceived;
     boost::signals2::signal<void(std::string)>     _errorEmitted;
+    DataHandler                                    _dataHandler;
+    bool                                           _dataSlots; // connectDataReceived was called
 };
 
 //------------------------------------------------------------------------------
@@ -14,6 +14,9 @@
 //  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
+#include <chrono>
+#include <cstddef>
+
 namespace network 
 {
 
@@ -32,8 +35,81 @@ namespace network
     {
         constexpr int failtureCountForDisconnect = 3;
 
+        // Limits of the stream transport, larger frames are rejected
+        constexpr size_t maxMessageSize = 64 * 1024 * 1024;
+        constexpr size_t maxQueuedBytes = 256 * 1024 * 1024; // per connection, not yet written to the socket
+        constexpr size_t receiveChunk   = 64 * 1024;         // payloads are buffered as they arrive, not as announced
+
+        // Off by default: peers built before heartbeats reject ping frames as invalid headers
+        constexpr std::chrono::milliseconds heartbeatInterval { 0 };
+        constexpr std::chrono::milliseconds readTimeout       { 10000 };
+        constexpr std::chrono::milliseconds idleTimeout       { 0 };
+
+        constexpr std::chrono::milliseconds timerWheelTick    { 250 };
+        constexpr size_t                    timerWheelSlots   = 256;
+
+        constexpr size_t                    maxConnections       = 0;
+        constexpr size_t                    acceptBatch          = 16;
+        constexpr int                       listenBacklog        = 512;
+        constexpr double                    connectionRatePerIP  = 0;
+        constexpr double                    connectionBurstPerIP = 20;
+        constexpr std::chrono::milliseconds acceptRetryDelay     { 100 };
+        constexpr size_t                    rateTableSize        = 4096;
+
+        constexpr bool                      datagrams            = false;
+        constexpr std::chrono::milliseconds announceInterval     { 250 };  // until the server acknowledged
+
+        constexpr double                    messageRatePerClient  = 0;
+        constexpr double                    messageBurstPerClient = 100;
+        constexpr double                    byteRatePerClient     = 0;
+        constexpr double                    byteBurstPerClient    = 1024 * 1024;
+        constexpr std::chrono::milliseconds throttleTick          { 5 };
+        constexpr size_t                    throttleSlots         = 1024;
     }
 
+//------------------------------------------------------------------------------
+
+    struct HeartbeatConfig
+    {
+        // Send a ping after this much silence from the peer (0 disables pings)
+        std::chrono::milliseconds interval    = cfg::heartbeatInterval;
+        // Time the peer has to answer a ping before it is considered dead
+        std::chrono::milliseconds readTimeout = cfg::readTimeout;
+        // Close the connection after this long without data frames (0 disables)
+        std::chrono::milliseconds idleTimeout = cfg::idleTimeout;
+    };
+
+    struct ServerConfig
+    {
+        HeartbeatConfig heartbeat;
+
+        // Stop accepting while this many clients are connected (0 = unlimited)
+        size_t maxConnections       = cfg::maxConnections;
+        // Connections accepted per event loop turn
+        size_t acceptBatch          = cfg::acceptBatch;
+        // Pending connections queued by the OS
+        int    listenBacklog        = cfg::listenBacklog;
+        // New connections per second and remote address (0 = unlimited) and the allowed burst
+        double connectionRatePerIP  = cfg::connectionRatePerIP;
+        double connectionBurstPerIP = cfg::connectionBurstPerIP;
+
+        // Open an unreliable UDP channel on the same port for sendUnreliable (TCP only)
+        bool   datagrams            = cfg::datagrams;
+
+        // Inbound limits per client: messages and bytes per second (0 = unlimited) and the
+        // allowed bursts. A client over its limit is not read from until its budget recovered,
+        // its datagrams are dropped meanwhile. Held clients are exempt from the read timeout.
+        double messageRatePerClient  = cfg::messageRatePerClient;
+        double messageBurstPerClient = cfg::messageBurstPerClient;
+        double byteRatePerClient     = cfg::byteRatePerClient;
+        double byteBurstPerClient    = cfg::byteBurstPerClient;
+    };
+
+    struct ClientConfig
+    {
+        HeartbeatConfig heartbeat;
+    };
+
 //------------------------------------------------------------------------------
 
 }
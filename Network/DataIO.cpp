@@ -1,53 +1,150 @@
 #include "DataIO.h"
+#include "Frame.h"
+#include "Common.h"
 
 #include <boost/asio.hpp>
 
-#include <iomanip>
+#include <algorithm>
+#include <vector>
 
 
 namespace network {
 
 //------------------------------------------------------------------------------
 
-namespace cfg {
-    static constexpr size_t headerLength   = 8;
-    static constexpr size_t ringbufferSize = 50;
+void DataIO::setDataReceivedHandler(std::function<void(SocketPtr, std::string)> handler) 
+{ _dataReceived = std::move(handler); }
+
+void DataIO::setHeartbeatReceivedHandler(std::function<void(SocketPtr)> handler)
+{ _heartbeatReceived = std::move(handler); }
+
+void DataIO::setDatagramTokenReceivedHandler(std::function<void(SocketPtr, uint64_t)> handler)
+{ _datagramTokenReceived = std::move(handler); }
+
+void DataIO::setDatagramAckReceivedHandler(std::function<void(SocketPtr)> handler)
+{ _datagramAckReceived = std::move(handler); }
+
+void DataIO::setReceiveProgressHandler(std::function<void(SocketPtr)> handler)
+{ _receiveProgress = std::move(handler); }
+
+void DataIO::setErrorEmittedHandler(std::function<void(SocketPtr, std::string)> handler) 
+{ _errorEmitted = std::move(handler); }
+
+void DataIO::setSocketDisconnectHandler(std::function<void(SocketPtr)> handler)
+{ _socketDisconnect = std::move(handler); }
+
+//------------------------------------------------------------------------------
+
+void DataIO::send(DataIO::SocketPtr socket, const std::string& data)
+{
+    if (!frame::validDataSize(data.size()))
+        return;
+
+    std::string frame;
+    frame.reserve(frame::headerLength + data.size());
+    frame.append(frame::dataHeader(data.size()));
+    frame.append(data);
+    queue(socket, std::move(frame));
 }
 
 //------------------------------------------------------------------------------
 
-DataIO::DataIO() 
-: _ringbuffer(cfg::ringbufferSize)
-{ }
+void DataIO::ping(DataIO::SocketPtr socket)
+{
+    queue(socket, frame::pingFrame());
+}
 
 //------------------------------------------------------------------------------
 
-DataIO::Connection DataIO::connectDataReceived(const std::function<void(SocketPtr, std::string)> handler) 
-{ return _dataReceived.connect(handler); }
+void DataIO::sendDatagramToken(DataIO::SocketPtr socket, uint64_t token)
+{
+    queue(socket, frame::tokenFrame(token));
+}
 
-DataIO::Connection DataIO::connectErrorEmitted(const std::function<void(SocketPtr, std::string)> handler) 
-{ return _errorEmitted.connect(handler); }
+//------------------------------------------------------------------------------
 
-DataIO::Connection DataIO::connectSocketDisconnect(const std::function<void(SocketPtr)> handler)
-{ return _socketDisconnect.connect(handler); }
+void DataIO::sendDatagramAck(DataIO::SocketPtr socket)
+{
+    queue(socket, frame::datagramAckFrame());
+}
 
 //------------------------------------------------------------------------------
 
-void DataIO::send(DataIO::SocketPtr socket, const std::string& data)
+void DataIO::queue(DataIO::SocketPtr socket, std::string frame)
+{
+    auto& queue = _sendQueues[socket];
+    if (queue.overflowed)
+        return;
+
+    // Dropping a frame would break the stream, so a peer that does not keep up is
+    // disconnected. Posted, the caller may be iterating over its connections.
+    if (queue.queuedBytes + frame.size() > cfg::maxQueuedBytes) {
+        queue.overflowed = true;
+        boost::asio::post(socket->get_executor(), [socket,this]
+        {
+            _errorEmitted(socket, "DataIO: send queue full, peer disconnected");
+            _socketDisconnect(socket);
+        });
+        return;
+    }
+
+    queue.queuedBytes += frame.size();
+    queue.frames.push_back(std::move(frame));
+
+    if (queue.writing == 0)
+        write(socket);
+}
+
+//------------------------------------------------------------------------------
+
+size_t DataIO::queuedBytes(DataIO::SocketPtr socket) const
+{
+    auto it = _sendQueues.find(socket);
+    return it != _sendQueues.end() ? it->second.queuedBytes : 0;
+}
+
+//------------------------------------------------------------------------------
+
+void DataIO::write(DataIO::SocketPtr socket)
 {
-    auto header = createHeader(data.size()); 
+    auto& queue = _sendQueues[socket];
 
-    DataBuffer buffer;
-    _ringbuffer.push_back(header);
-    buffer.push_back(boost::asio::buffer(_ringbuffer.back()));
-    _ringbuffer.push_back(data);
-    buffer.push_back(boost::asio::buffer(_ringbuffer.back()));
+    std::vector<boost::asio::const_buffer> buffers;
+    buffers.reserve(queue.frames.size());
+    for (auto& f : queue.frames)
+        buffers.push_back(boost::asio::buffer(f));
+    queue.writing = queue.frames.size();
 
-    boost::asio::async_write(*socket, buffer,
+    boost::asio::async_write(*socket, buffers,
             [socket,this](boost::system::error_code er, std::size_t )
     {
-        if (er) 
+        auto it = _sendQueues.find(socket);
+        if (it == _sendQueues.end())
+            return;
+
+        if (er) {
+            _sendQueues.erase(it);
             _errorEmitted(socket, "DataIO: sending failed!");
+            return;
+        }
+
+        auto& queue = it->second;
+        if (queue.overflowed) {
+            _sendQueues.erase(it);
+            return;
+        }
+
+        for (size_t i = 0; i < queue.writing; ++i) {
+            queue.queuedBytes -= queue.frames.front().size();
+            queue.frames.pop_front();
+        }
+        queue.writing = 0;
+
+        // Drop the state of idle sockets, closed sockets must not stay in the map
+        if (queue.frames.empty())
+            _sendQueues.erase(it);
+        else
+            write(socket);
     });
 }
 
@@ -55,73 +152,134 @@ void DataIO::send(DataIO::SocketPtr socket, const std::string& data)
 
 void DataIO::listen(DataIO::SocketPtr socket)
 {
-    _receiveHeaderBuffer.resize(cfg::headerLength);
+    auto receive = std::make_shared<Receive>();
 
-    boost::asio::async_read(*socket, boost::asio::buffer(_receiveHeaderBuffer),
-            [socket,this](const boost::system::error_code &ec, std::size_t )
+    boost::asio::async_read(*socket, boost::asio::buffer(receive->header),
+            [socket,receive,this](const boost::system::error_code &ec, std::size_t )
     {
         if (ec) {
-            _errorEmitted(socket, "DataIO: receiving header failed!");
+            receiveFailed(socket, ec, "DataIO: receiving header failed!");
+            return;
         }
-        else {
-            auto headerStr = std::string(&_receiveHeaderBuffer[0], _receiveHeaderBuffer.size());
-            auto size  = dataSize(headerStr);
-            if (size > 0) {
-                receiveData(socket, size);
-            }
-            else {
-                _errorEmitted(socket, "DataIO: received invalid header");
-            }
+
+        auto header = frame::parseHeader(receive->header, sizeof(receive->header));
+        switch (header.type)
+        {
+        case frame::TYPE_DATA:
+            receiveData(socket, receive, header.size);
+            break;
+        case frame::TYPE_PING:
+            queue(socket, frame::pongFrame());
+            _heartbeatReceived(socket);
+            break;
+        case frame::TYPE_PONG:
+            _heartbeatReceived(socket);
+            break;
+        case frame::TYPE_TOKEN:
+            if (_datagramTokenReceived) receiveDatagramToken(socket, receive);
+            else                        protocolViolation(socket, "DataIO: unexpected token frame");
+            break;
+        case frame::TYPE_DATAGRAM_ACK:
+            if (_datagramAckReceived) _datagramAckReceived(socket);
+            else                      protocolViolation(socket, "DataIO: unexpected datagram ack");
+            break;
+        case frame::TYPE_INVALID:
+            // The stream cannot be resynchronized after a broken header
+            protocolViolation(socket, "DataIO: received invalid header");
+            break;
         }
     });
+}
+
+//------------------------------------------------------------------------------
 
+void DataIO::receiveData(DataIO::SocketPtr socket, ReceivePtr receive, size_t size)
+{
+    receive->size = size;
+    receive->data.clear();
+    receiveChunk(socket, receive);
 }
 
 //------------------------------------------------------------------------------
 
-void DataIO::receiveData(DataIO::SocketPtr socket, size_t size)
+void DataIO::receiveChunk(DataIO::SocketPtr socket, ReceivePtr receive)
 {
-    _receiveDataBuffer.resize(size);
+    // A header alone must not make us allocate cfg::maxMessageSize, so the buffer
+    // only grows by what the peer actually sends
+    auto offset = receive->data.size();
+    auto chunk  = std::min(cfg::receiveChunk, receive->size - offset);
+    receive->data.resize(offset + chunk);
 
-    boost::asio::async_read(*socket, boost::asio::buffer(_receiveDataBuffer),
-                        [socket, this](const boost::system::error_code &ec, std::size_t )
+    socket->async_read_some(boost::asio::buffer(&receive->data[offset], chunk),
+                        [socket, receive, offset, this](const boost::system::error_code &ec, std::size_t bytes)
     {
-        if (boost::asio::error::eof == ec) {
-            _errorEmitted(socket, "DataIO: error::eof");
-            _socketDisconnect(socket);
-        }
-        else if (boost::asio::error::connection_reset == ec) {
-            _errorEmitted(socket, "DataIO: connection_reset");
-            _socketDisconnect(socket);
+        if (ec) {
+            receiveFailed(socket, ec, "DataIO: receiving data failed!");
+            return;
         }
-        else if (ec) {
-            _errorEmitted(socket, "DataIO: receiving data failed!");
+
+        receive->data.resize(offset + bytes);
+        if (receive->data.size() < receive->size)
+        {
+            // A slow peer is still alive, its pong is queued behind this frame
+            if (_receiveProgress)
+                _receiveProgress(socket);
+            receiveChunk(socket, receive);
         }
         else
         {
-            std::string dataString(&_receiveDataBuffer[0], _receiveDataBuffer.size());
-            _dataReceived(socket, dataString);
+            _dataReceived(socket, std::move(receive->data));
+        }
+    });
+}
+
+//------------------------------------------------------------------------------
+
+void DataIO::receiveDatagramToken(DataIO::SocketPtr socket, ReceivePtr receive)
+{
+    receive->data.resize(frame::tokenLength);
+
+    boost::asio::async_read(*socket, boost::asio::buffer(&receive->data[0], frame::tokenLength),
+                        [socket, receive, this](const boost::system::error_code &ec, std::size_t )
+    {
+        if (ec) {
+            receiveFailed(socket, ec, "DataIO: receiving token failed!");
+            return;
+        }
+
+        uint64_t token = 0;
+        if (frame::parseToken(receive->data.data(), receive->data.size(), token)) {
+            _datagramTokenReceived(socket, token);
+        }
+        else {
+            protocolViolation(socket, "DataIO: received invalid token");
         }
     });
 }
 
 //------------------------------------------------------------------------------
 
-std::string DataIO::createHeader(size_t dataSize)
+void DataIO::protocolViolation(DataIO::SocketPtr socket, const std::string& error)
 {
-    std::ostringstream ostream;
-    ostream << std::setw(cfg::headerLength) << std::hex << dataSize;
-    return ostream.str();
+    _errorEmitted(socket, error);
+    _socketDisconnect(socket);
 }
 
 //------------------------------------------------------------------------------
 
-size_t DataIO::dataSize(std::string header)
+void DataIO::receiveFailed(DataIO::SocketPtr socket, const boost::system::error_code& ec, const std::string& error)
 {
-    std::istringstream is(header);
-    size_t size = 0;
-    is >> std::hex >> size;
-    return size;
+    if (boost::asio::error::eof == ec) {
+        _errorEmitted(socket, "DataIO: error::eof");
+        _socketDisconnect(socket);
+    }
+    else if (boost::asio::error::connection_reset == ec) {
+        _errorEmitted(socket, "DataIO: connection_reset");
+        _socketDisconnect(socket);
+    }
+    else {
+        _errorEmitted(socket, error);
+    }
 }
 
 
@@ -13,13 +13,14 @@
 //  You should have received a copy of the GNU General Public License
 //  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
+#include "Frame.h"
 
-#include <boost/asio/ip/tcp.hpp>
-#include <boost/circular_buffer.hpp>
-#include <boost/signals2.hpp>
+#include <boost/asio/generic/stream_protocol.hpp>
 
+#include <cstdint>
 #include <string>
-#include <vector>
+#include <deque>
+#include <unordered_map>
 #include <functional>
 #include <memory>
 
@@ -30,39 +31,68 @@ namespace network {
 
 class DataIO 
 {
-    using DataBuffer  = std::vector<boost::asio::const_buffer>;
-    using RingBuffer  = boost::circular_buffer<std::string>;
-    using SocketPtr   = std::shared_ptr<boost::asio::ip::tcp::socket>;
-    using Connection  = boost::signals2::connection;
+    using SocketPtr   = std::shared_ptr<boost::asio::generic::stream_protocol::socket>;
 
 public:
 
-    DataIO();
-
-    void send(SocketPtr, const std::string&);
+    void send(SocketPtr, const std::string&); // Callers reject sizes that are not frame::validDataSize
+    void ping(SocketPtr); // Peer answers with a pong, both end up in heartbeatReceived
+    void sendDatagramToken(SocketPtr, uint64_t token);
+    void sendDatagramAck(SocketPtr);
     void listen(SocketPtr); // Not blocking
 
-    // Callbacks 
-    Connection connectSocketDisconnect(const std::function<void(SocketPtr)>);
-    Connection connectDataReceived(const std::function<void(SocketPtr, std::string)>);
-    Connection connectErrorEmitted(const std::function<void(SocketPtr, std::string)>);
-
-private:
+    auto queuedBytes(SocketPtr) const -> size_t; // queued frames not yet written to the socket
 
-    void receiveData(SocketPtr socket, size_t size);
-    auto createHeader(size_t dataSize)           -> std::string;
-    auto dataSize(std::string headerData)        -> size_t;
+    // Callbacks, one handler each (called once per frame, so no signal dispatch here).
+    // Control frames without a handler are a protocol violation: the peer is disconnected.
+    void setSocketDisconnectHandler(std::function<void(SocketPtr)>);
+    void setDataReceivedHandler(std::function<void(SocketPtr, std::string)>);
+    void setHeartbeatReceivedHandler(std::function<void(SocketPtr)>);
+    void setDatagramTokenReceivedHandler(std::function<void(SocketPtr, uint64_t)>);
+    void setDatagramAckReceivedHandler(std::function<void(SocketPtr)>);
+    void setReceiveProgressHandler(std::function<void(SocketPtr)>); // optional, part of a frame arrived
+    void setErrorEmittedHandler(std::function<void(SocketPtr, std::string)>);
 
-    RingBuffer        _ringbuffer;
-    std::vector<char> _receiveHeaderBuffer;
-    std::vector<char> _receiveDataBuffer;
+private:
 
-    boost::signals2::signal<void(SocketPtr)> _socketDisconnect;
-    boost::signals2::signal<void(SocketPtr, std::string)> _dataReceived;
-    boost::signals2::signal<void(SocketPtr, std::string)> _errorEmitted;
+    // Frames of one socket waiting to be written. Only one write per socket is
+    // in flight (concurrent async_writes may interleave), it takes all queued frames.
+    struct SendQueue
+    {
+        std::deque<std::string> frames;
+        size_t                  writing     = 0;
+        size_t                  queuedBytes = 0;
+        bool                    overflowed  = false; // the connection is being dropped
+    };
+
+    // Read state of one frame, owned by its handlers so sockets never share buffers
+    struct Receive
+    {
+        char        header[frame::headerLength];
+        std::string data;
+        size_t      size = 0; // announced by the header, data grows up to it
+    };
+    using ReceivePtr = std::shared_ptr<Receive>;
+
+    void queue(SocketPtr socket, std::string frame);
+    void write(SocketPtr socket);
+    void receiveData(SocketPtr socket, ReceivePtr receive, size_t size);
+    void receiveChunk(SocketPtr socket, ReceivePtr receive);
+    void receiveDatagramToken(SocketPtr socket, ReceivePtr receive);
+    void protocolViolation(SocketPtr socket, const std::string& error);
+    void receiveFailed(SocketPtr socket, const boost::system::error_code& ec, const std::string& error);
+
+    std::unordered_map<SocketPtr, SendQueue> _sendQueues;
+
+    std::function<void(SocketPtr)>              _socketDisconnect;
+    std::function<void(SocketPtr, std::string)> _dataReceived;
+    std::function<void(SocketPtr)>              _heartbeatReceived;
+    std::function<void(SocketPtr, uint64_t)>    _datagramTokenReceived;
+    std::function<void(SocketPtr)>              _datagramAckReceived;
+    std::function<void(SocketPtr)>              _receiveProgress;
+    std::function<void(SocketPtr, std::string)> _errorEmitted;
 };
 
 
 }
 
-
@@ -0,0 +1,258 @@
+#include "DatagramIO.h"
+
+#include <boost/asio.hpp>
+
+#include <cstring>
+
+
+namespace network {
+
+//------------------------------------------------------------------------------
+
+namespace cfg {
+    static constexpr uint8_t datagramMagic      = 0xD7;
+    static constexpr size_t  datagramHeader     = 1 + 8 + 4;  // magic, token, sequence
+    static constexpr size_t  datagramSize       = 1200;       // stays below common path MTUs
+    static constexpr size_t  datagramBufferSize = 65536;
+}
+
+namespace 
+{
+    template <typename T>
+    void put(std::string& packet, T value)
+    {
+        for (size_t i = 0; i < sizeof(T); ++i)
+            packet.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+
+    template <typename T>
+    bool get(const char*& pos, const char* end, T& value)
+    {
+        if (static_cast<size_t>(end - pos) < sizeof(T))
+            return false;
+
+        value = 0;
+        for (size_t i = 0; i < sizeof(T); ++i)
+            value |= static_cast<T>(static_cast<uint8_t>(pos[i])) << (8 * i);
+        pos += sizeof(T);
+        return true;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+DatagramIO::DatagramIO(boost::asio::io_service& ioService)
+: _ioService(ioService)
+, _socket(ioService)
+, _receiveBuffer(cfg::datagramBufferSize)
+{ }
+
+//------------------------------------------------------------------------------
+
+void DatagramIO::setDataReceivedHandler(std::function<void(const Endpoint&, uint64_t, const Messages&)> handler) 
+{ _dataReceived = std::move(handler); }
+
+void DatagramIO::setErrorEmittedHandler(std::function<void(std::string)> handler) 
+{ _errorEmitted = std::move(handler); }
+
+//------------------------------------------------------------------------------
+
+void DatagramIO::open(const Endpoint& local)
+{
+    _socket.open(local.protocol());
+    _socket.bind(local);
+}
+
+//------------------------------------------------------------------------------
+
+void DatagramIO::close()
+{
+    boost::system::error_code ec;
+    _socket.cancel(ec);
+    _socket.close(ec);
+    _peers.clear();
+}
+
+//------------------------------------------------------------------------------
+
+bool DatagramIO::isOpen() const
+{
+    return _socket.is_open();
+}
+
+//------------------------------------------------------------------------------
+
+void DatagramIO::addToken(uint64_t token)
+{
+    _peers.emplace(token, Peer());
+}
+
+void DatagramIO::removeToken(uint64_t token)
+{
+    _peers.erase(token);
+}
+
+//------------------------------------------------------------------------------
+
+void DatagramIO::startPacket(std::string& packet, uint64_t token, Peer& peer)
+{
+    packet.clear();
+    packet.reserve(cfg::datagramSize);
+    put<uint8_t>(packet, cfg::datagramMagic);
+    put<uint64_t>(packet, token);
+    put<uint32_t>(packet, ++peer.sendSequence);
+}
+
+//------------------------------------------------------------------------------
+
+void DatagramIO::announce(const Endpoint& to, uint64_t token)
+{
+    auto it = _peers.find(token);
+    if (it == _peers.end())
+        return;
+
+    std::string packet;
+    startPacket(packet, token, it->second);
+    sendPacket(to, std::move(packet));
+}
+
+//------------------------------------------------------------------------------
+
+void DatagramIO::send(const Endpoint& to, uint64_t token, const std::string& data)
+{
+    if (data.size() + 2 > cfg::datagramSize - cfg::datagramHeader) {
+        _errorEmitted("DatagramIO: message too large for a datagram");
+        return;
+    }
+
+    auto it = _peers.find(token);
+    if (it == _peers.end())
+        return;
+
+    auto& peer = it->second;
+    if (!peer.pendingPacket.empty() && 
+        (peer.pendingEndpoint != to || peer.pendingPacket.size() + 2 + data.size() > cfg::datagramSize))
+        flush(peer);
+
+    if (peer.pendingPacket.empty())
+        startPacket(peer.pendingPacket, token, peer);
+
+    peer.pendingEndpoint = to;
+    put<uint16_t>(peer.pendingPacket, static_cast<uint16_t>(data.size()));
+    peer.pendingPacket.append(data);
+
+    // Everything sent until the next loop turn goes into the same datagram
+    if (!peer.flushPosted)
+    {
+        peer.flushPosted = true;
+        _ioService.post([this, token]
+        {
+            auto it = _peers.find(token);
+            if (it != _peers.end()) 
+            {
+                it->second.flushPosted = false;
+                flush(it->second);
+            }
+        });
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void DatagramIO::flush(Peer& peer)
+{
+    if (peer.pendingPacket.empty())
+        return;
+
+    sendPacket(peer.pendingEndpoint, std::move(peer.pendingPacket));
+    peer.pendingPacket.clear();
+}
+
+//------------------------------------------------------------------------------
+
+void DatagramIO::sendPacket(const Endpoint& to, std::string packet)
+{
+    if (!_socket.is_open())
+        return;
+
+    auto buffer = std::make_shared<std::string>(std::move(packet));
+    _socket.async_send_to(boost::asio::buffer(*buffer), to,
+            [buffer,this](const boost::system::error_code& ec, std::size_t)
+    {
+        if (ec && ec != boost::asio::error::operation_aborted) 
+            _errorEmitted("DatagramIO: sending failed!");
+    });
+}
+
+//------------------------------------------------------------------------------
+
+void DatagramIO::listen()
+{
+    _socket.async_receive_from(boost::asio::buffer(_receiveBuffer), _remote,
+            [this](const boost::system::error_code& ec, std::size_t size)
+    {
+        if (ec == boost::asio::error::operation_aborted || !_socket.is_open())
+            return;
+
+        if (!ec)
+            receive(size);
+
+        listen();
+    });
+}
+
+//------------------------------------------------------------------------------
+
+void DatagramIO::receive(size_t size)
+{
+    const char* pos = _receiveBuffer.data();
+    const char* end = pos + size;
+
+    uint8_t  magic    = 0;
+    uint64_t token    = 0;
+    uint32_t sequence = 0;
+    if (!get(pos, end, magic) || magic != cfg::datagramMagic || !get(pos, end, token) || !get(pos, end, sequence))
+        return;
+
+    Messages messages;
+    while (pos != end)
+    {
+        uint16_t length = 0;
+        if (!get(pos, end, length) || static_cast<size_t>(end - pos) < length)
+            return;
+
+        messages.emplace_back(pos, length);
+        pos += length;
+    }
+
+    auto it = _peers.find(token);
+    if (it == _peers.end())
+        return;
+
+    // Only the latest state matters, drop everything older than what we already have
+    auto& peer = it->second;
+    if (peer.received && static_cast<int32_t>(sequence - peer.receiveSequence) <= 0)
+        return;
+
+    peer.received        = true;
+    peer.receiveSequence = sequence;
+    _dataReceived(_remote, token, messages);
+}
+
+//------------------------------------------------------------------------------
+
+bool toDatagramEndpoint(const boost::asio::generic::stream_protocol::endpoint& in, 
+                        boost::asio::ip::udp::endpoint& out)
+{
+    auto family = in.protocol().family();
+    if ((family != AF_INET && family != AF_INET6) || in.size() > out.capacity())
+        return false;
+
+    std::memcpy(out.data(), in.data(), in.size());
+    out.resize(in.size());
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+}
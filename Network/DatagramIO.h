@@ -0,0 +1,100 @@
+// Copyright (c) 2017  Mathias Roder (teuse@mailbox.org)
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+#include <boost/asio/generic/stream_protocol.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <boost/asio/io_service.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+
+
+namespace network {
+
+//------------------------------------------------------------------------------
+
+// Unreliable channel next to a stream connection. Each datagram carries the
+// token of its connection and a sequence number. Datagrams that are older than
+// the newest one received for a token are dropped, as are tokens that were
+// not added. Messages sent within one event loop turn are batched into as few
+// datagrams as possible.
+class DatagramIO 
+{
+public:
+
+    using Endpoint = boost::asio::ip::udp::endpoint;
+    using Messages = std::vector<std::string>;
+
+    DatagramIO(boost::asio::io_service& ioService);
+
+    void open(const Endpoint& local);
+    void close();
+    auto isOpen() const -> bool;
+
+    void addToken(uint64_t token);
+    void removeToken(uint64_t token);
+
+    void send(const Endpoint& to, uint64_t token, const std::string& data);
+    void announce(const Endpoint& to, uint64_t token); // Empty datagram, lets the peer learn our endpoint
+    void listen(); // Not blocking, keeps receiving until closed
+
+    // Callbacks, Messages is empty for announcements
+    void setDataReceivedHandler(std::function<void(const Endpoint&, uint64_t, const Messages&)>);
+    void setErrorEmittedHandler(std::function<void(std::string)>);
+
+private:
+
+    struct Peer
+    {
+        uint32_t    sendSequence    = 0;
+        uint32_t    receiveSequence = 0;
+        bool        received        = false;
+
+        Endpoint    pendingEndpoint;
+        std::string pendingPacket;
+        bool        flushPosted     = false;
+    };
+
+    void flush(Peer& peer);
+    void sendPacket(const Endpoint& to, std::string packet);
+    void startPacket(std::string& packet, uint64_t token, Peer& peer);
+    void receive(size_t size);
+
+    boost::asio::io_service&      _ioService;
+    boost::asio::ip::udp::socket  _socket;
+    Endpoint                      _remote;
+    std::vector<char>             _receiveBuffer;
+
+    std::unordered_map<uint64_t, Peer> _peers;
+
+    std::function<void(const Endpoint&, uint64_t, const Messages&)> _dataReceived;
+    std::function<void(std::string)>                                _errorEmitted;
+};
+
+//------------------------------------------------------------------------------
+
+// Address and port of an IP stream endpoint as a datagram endpoint,
+// false for endpoints of other families (e.g. unix domain sockets)
+bool toDatagramEndpoint(const boost::asio::generic::stream_protocol::endpoint& in, 
+                        boost::asio::ip::udp::endpoint& out);
+
+//------------------------------------------------------------------------------
+
+}
@@ -0,0 +1,117 @@
+#include "Frame.h"
+#include "Common.h"
+
+#include <cstring>
+
+
+namespace network {
+namespace frame {
+
+//------------------------------------------------------------------------------
+
+namespace 
+{
+    const char pingHeader[]  = "    ping";
+    const char pongHeader[]  = "    pong";
+    const char tokenHeader[] = "   token";
+    const char ackHeader[]   = "   dgack";
+
+    const char hexDigits[]   = "0123456789abcdef";
+
+    int hexValue(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    std::string toHex(uint64_t value, size_t width, char fill)
+    {
+        std::string result(width, fill);
+        auto pos = width;
+        do {
+            result[--pos] = hexDigits[value & 0xF];
+            value >>= 4;
+        } while (value != 0 && pos > 0);
+        return result;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+std::string dataHeader(size_t dataSize)
+{
+    return toHex(dataSize, headerLength, ' ');
+}
+
+std::string pingFrame()                { return std::string(pingHeader, headerLength); }
+std::string pongFrame()                { return std::string(pongHeader, headerLength); }
+std::string tokenFrame(uint64_t token) { return std::string(tokenHeader, headerLength) + toHex(token, tokenLength, '0'); }
+std::string datagramAckFrame()         { return std::string(ackHeader, headerLength); }
+
+//------------------------------------------------------------------------------
+
+bool validDataSize(size_t size)
+{
+    return size > 0 && size <= cfg::maxMessageSize;
+}
+
+//------------------------------------------------------------------------------
+
+Header parseHeader(const char* data, size_t length)
+{
+    const Header invalid = { TYPE_INVALID, 0 };
+    if (length != headerLength)
+        return invalid;
+
+    if (std::memcmp(data, pingHeader, headerLength) == 0)  return { TYPE_PING,  0 };
+    if (std::memcmp(data, pongHeader, headerLength) == 0)  return { TYPE_PONG,  0 };
+    if (std::memcmp(data, tokenHeader, headerLength) == 0) return { TYPE_TOKEN, tokenLength };
+    if (std::memcmp(data, ackHeader, headerLength) == 0)   return { TYPE_DATAGRAM_ACK, 0 };
+
+    // Leading spaces, then nothing but hex digits up to the end
+    size_t pos = 0;
+    while (pos < length && data[pos] == ' ')
+        ++pos;
+
+    if (pos == length)
+        return invalid;
+
+    uint64_t size = 0;
+    for (; pos < length; ++pos)
+    {
+        auto digit = hexValue(data[pos]);
+        if (digit < 0)
+            return invalid;
+        size = size * 16 + static_cast<uint64_t>(digit);
+    }
+
+    if (size > cfg::maxMessageSize || !validDataSize(static_cast<size_t>(size)))
+        return invalid;
+
+    return { TYPE_DATA, static_cast<size_t>(size) };
+}
+
+//------------------------------------------------------------------------------
+
+bool parseToken(const char* data, size_t length, uint64_t& token)
+{
+    if (length != tokenLength)
+        return false;
+
+    token = 0;
+    for (size_t i = 0; i < length; ++i)
+    {
+        auto digit = hexValue(data[i]);
+        if (digit < 0)
+            return false;
+        token = token * 16 + static_cast<uint64_t>(digit);
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+}
+}
@@ -0,0 +1,67 @@
+// Copyright (c) 2017  Mathias Roder (teuse@mailbox.org)
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+namespace network {
+
+//------------------------------------------------------------------------------
+
+// Wire format of the stream transport. Every frame starts with an 8 byte header:
+// data frames carry the payload size as right aligned hex digits, control frames
+// use fixed headers that can never be a valid size.
+namespace frame
+{
+    constexpr size_t headerLength = 8;
+    constexpr size_t tokenLength  = 16; // payload of a token frame, 16 hex digits
+
+    enum Type 
+    {
+        TYPE_INVALID,
+        TYPE_DATA,
+        TYPE_PING,
+        TYPE_PONG,
+        TYPE_TOKEN,
+        TYPE_DATAGRAM_ACK  // the server received a datagram of this connection
+    };
+
+    struct Header
+    {
+        Type   type;
+        size_t size; // payload bytes following the header
+    };
+
+    auto dataHeader(size_t dataSize) -> std::string;
+    auto pingFrame()                 -> std::string;
+    auto pongFrame()                 -> std::string;
+    auto tokenFrame(uint64_t token)  -> std::string;
+    auto datagramAckFrame()          -> std::string;
+
+    // 0 < size <= cfg::maxMessageSize, the only payload sizes a data frame can carry
+    auto validDataSize(size_t size) -> bool;
+
+    // Never trusts its input: anything but a well-formed header of exactly 
+    // headerLength bytes with a valid data size is TYPE_INVALID
+    auto parseHeader(const char* data, size_t length) -> Header;
+    auto parseToken(const char* data, size_t length, uint64_t& token) -> bool;
+}
+
+//------------------------------------------------------------------------------
+
+}
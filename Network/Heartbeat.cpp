@@ -0,0 +1,74 @@
+#include "Heartbeat.h"
+
+#include <algorithm>
+
+
+namespace network {
+
+//------------------------------------------------------------------------------
+
+Heartbeat::Heartbeat(const HeartbeatConfig* config)
+: _config(config)
+, _lastReceived(Clock::now())
+, _lastData(_lastReceived)
+, _pingSent(_lastReceived)
+, _pingPending(false)
+{}
+
+//------------------------------------------------------------------------------
+
+bool Heartbeat::enabled() const
+{
+    return _config->interval.count() > 0 || _config->idleTimeout.count() > 0;
+}
+
+//------------------------------------------------------------------------------
+
+void Heartbeat::frameReceived(bool isData)
+{
+    _lastReceived = Clock::now();
+    _pingPending  = false;
+    if (isData)
+        _lastData = _lastReceived;
+}
+
+//------------------------------------------------------------------------------
+
+Heartbeat::Action Heartbeat::check(TimePoint now)
+{
+    if (_config->idleTimeout.count() > 0 && now - _lastData >= _config->idleTimeout)
+        return ACTION_IDLE_TIMEOUT;
+
+    if (_pingPending && now - _pingSent >= _config->readTimeout)
+        return ACTION_READ_TIMEOUT;
+
+    if (!_pingPending && _config->interval.count() > 0 && now - _lastReceived >= _config->interval)
+    {
+        _pingPending = true;
+        _pingSent    = now;
+        return ACTION_PING;
+    }
+
+    return ACTION_NONE;
+}
+
+//------------------------------------------------------------------------------
+
+Heartbeat::TimePoint Heartbeat::nextDeadline() const
+{
+    auto deadline = TimePoint::max();
+
+    if (_config->idleTimeout.count() > 0)
+        deadline = std::min(deadline, _lastData + _config->idleTimeout);
+
+    if (_pingPending)
+        deadline = std::min(deadline, _pingSent + _config->readTimeout);
+    else if (_config->interval.count() > 0)
+        deadline = std::min(deadline, _lastReceived + _config->interval);
+
+    return deadline;
+}
+
+//------------------------------------------------------------------------------
+
+}
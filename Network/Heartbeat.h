@@ -0,0 +1,64 @@
+// Copyright (c) 2017  Mathias Roder (teuse@mailbox.org)
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include "Common.h"
+
+#include <chrono>
+
+
+namespace network {
+
+//------------------------------------------------------------------------------
+
+// Liveness bookkeeping of one connection, see HeartbeatConfig
+class Heartbeat 
+{
+public:
+    using Clock     = std::chrono::steady_clock;
+    using TimePoint = Clock::time_point;
+
+    enum Action 
+    {
+        ACTION_NONE,
+        ACTION_PING,
+        ACTION_READ_TIMEOUT,
+        ACTION_IDLE_TIMEOUT
+    };
+
+    Heartbeat(const HeartbeatConfig* config);
+
+    auto enabled() const -> bool;
+
+    // Every received frame, or part of one, keeps the connection alive. Only complete
+    // data frames reset the idle timeout.
+    void frameReceived(bool isData);
+
+    // Decide what to do at 'now'. Returning ACTION_PING marks the ping as sent.
+    auto check(TimePoint now) -> Action;
+    auto nextDeadline() const -> TimePoint;
+
+private:
+
+    const HeartbeatConfig* _config;
+
+    TimePoint _lastReceived;
+    TimePoint _lastData;
+    TimePoint _pingSent;
+    bool      _pingPending;
+};
+
+//------------------------------------------------------------------------------
+
+}
@@ -0,0 +1,103 @@
+#include "Recorder.h"
+
+#include <cstring>
+
+
+namespace network {
+
+//------------------------------------------------------------------------------
+
+namespace cfg {
+    static constexpr char   captureMagic[8]  = { 'N', 'L', 'C', 'A', 'P', 'T', 'R', '\0' };
+    static constexpr size_t recordBufferSize = 1024 * 1024;
+}
+
+static_assert(sizeof(Recorder::FileHeader)   % Recorder::alignment == 0, "FileHeader breaks the alignment");
+static_assert(sizeof(Recorder::RecordHeader) % Recorder::alignment == 0, "RecordHeader breaks the alignment");
+
+constexpr uint32_t Recorder::version;
+constexpr size_t   Recorder::alignment;
+
+//------------------------------------------------------------------------------
+
+Recorder::Recorder()
+: _file(nullptr)
+{}
+
+Recorder::~Recorder()
+{
+    close();
+}
+
+//------------------------------------------------------------------------------
+
+bool Recorder::validHeader(const FileHeader& header)
+{
+    return std::memcmp(header.magic, cfg::captureMagic, sizeof(header.magic)) == 0 
+        && header.version == version;
+}
+
+//------------------------------------------------------------------------------
+
+bool Recorder::open(const std::string& path)
+{
+    close();
+
+    _file = std::fopen(path.c_str(), "wb");
+    if (!_file)
+        return false;
+
+    _fileBuffer.resize(cfg::recordBufferSize);
+    std::setvbuf(_file, _fileBuffer.data(), _IOFBF, _fileBuffer.size());
+
+    FileHeader header = {};
+    std::memcpy(header.magic, cfg::captureMagic, sizeof(header.magic));
+    header.version = version;
+
+    _start = std::chrono::steady_clock::now();
+    if (std::fwrite(&header, sizeof(header), 1, _file) != 1)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+void Recorder::close()
+{
+    if (_file)
+        std::fclose(_file);
+    _file = nullptr;
+}
+
+//------------------------------------------------------------------------------
+
+bool Recorder::record(Event event, uint64_t clientID, const std::string& data)
+{
+    if (!_file)
+        return false;
+
+    RecordHeader header = {};
+    header.timestamp = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - _start).count());
+    header.clientID  = clientID;
+    header.size      = static_cast<uint32_t>(data.size());
+    header.event     = event;
+
+    static const char padding[alignment] = {};
+    auto paddingSize = paddedSize(data.size()) - data.size();
+
+    bool ok = std::fwrite(&header, sizeof(header), 1, _file) == 1
+           && (data.empty() || std::fwrite(data.data(), data.size(), 1, _file) == 1)
+           && (paddingSize == 0 || std::fwrite(padding, paddingSize, 1, _file) == 1);
+
+    if (!ok)
+        close();
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+
+}
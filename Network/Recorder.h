@@ -0,0 +1,85 @@
+// Copyright (c) 2017  Mathias Roder (teuse@mailbox.org)
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+namespace network {
+
+//------------------------------------------------------------------------------
+
+// Binary capture of the traffic a Server receives, read by NetworkLib_replay.
+//
+// A capture is a FileHeader followed by records. Each record is a RecordHeader
+// and its payload, padded to 8 bytes, so a capture can be memory mapped and 
+// walked in place. All fields are in host byte order.
+class Recorder 
+{
+public:
+
+    enum Event : uint8_t
+    {
+        EVENT_CONNECT    = 1,
+        EVENT_DISCONNECT = 2,
+        EVENT_DATA       = 3, // frame received over the stream connection
+        EVENT_DATAGRAM   = 4  // message received over the datagram channel
+    };
+
+    struct FileHeader
+    {
+        char     magic[8];  // "NLCAPTR" 
+        uint32_t version;
+        uint32_t reserved;
+    };
+
+    struct RecordHeader
+    {
+        uint64_t timestamp; // nanoseconds since the capture started
+        uint64_t clientID;
+        uint32_t size;      // payload bytes, the record is padded to 'alignment'
+        uint8_t  event;
+        uint8_t  reserved[3];
+    };
+
+    static constexpr uint32_t version   = 1;
+    static constexpr size_t   alignment = 8;
+
+    static auto validHeader(const FileHeader&) -> bool;
+    static auto paddedSize(size_t size)        -> size_t { return (size + alignment - 1) / alignment * alignment; }
+
+    Recorder();
+    ~Recorder();
+
+    auto open(const std::string& path) -> bool;
+    void close();
+    auto isOpen() const -> bool { return _file != nullptr; }
+
+    auto record(Event event, uint64_t clientID, const std::string& data = std::string()) -> bool;
+
+private:
+
+    std::FILE*                            _file;
+    std::vector<char>                     _fileBuffer;
+    std::chrono::steady_clock::time_point _start;
+};
+
+//------------------------------------------------------------------------------
+
+}
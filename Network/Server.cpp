@@ -1,11 +1,28 @@
 #include "Server.h"
 #include "DataIO.h"
+#include "DatagramIO.h"
+#include "Frame.h"
 #include "Common.h"
+#include "Heartbeat.h"
+#include "Recorder.h"
+#include "TimerWheel.h"
+#include "TokenBucket.h"
 
 #include <boost/asio.hpp>
 
+#include <cstdio>
+#include <random>
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <utility>
 #include <vector>
+#include <deque>
+#include <list>
+#include <unordered_map>
 #include <algorithm>
 #include <iostream>
 
@@ -19,6 +36,24 @@ namespace
         static ClientID idCounter = 0;
         return ++idCounter;
     }
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    // Remove the socket file a previous run left behind. Anything else at 'path', including
+    // the socket of a server that still accepts, is kept and binding reports the conflict.
+    void removeStaleSocket(const std::string& path)
+    {
+        struct stat status;
+        if (::lstat(path.c_str(), &status) != 0 || !S_ISSOCK(status.st_mode))
+            return;
+
+        boost::asio::io_service ioService;
+        boost::asio::local::stream_protocol::socket probe(ioService);
+        boost::system::error_code ec;
+        probe.connect(boost::asio::local::stream_protocol::endpoint(path), ec);
+        if (ec == boost::asio::error::connection_refused)
+            ::unlink(path.c_str());
+    }
+#endif
 }
 
 //------------------------------------------------------------------------------
@@ -26,49 +61,116 @@ namespace
 class Server::Impl 
 {
     using Connection = boost::signals2::connection;
-    using SocketPtr  = std::shared_ptr<boost::asio::ip::tcp::socket>;
+    using Socket     = boost::asio::generic::stream_protocol::socket;
+    using Endpoint   = boost::asio::generic::stream_protocol::endpoint;
+    using Acceptor   = boost::asio::basic_socket_acceptor<boost::asio::generic::stream_protocol>;
+    using SocketPtr  = std::shared_ptr<Socket>;
 
     class Client 
     {
     public:
-        Client(SocketPtr s) : socket(s), errorCount(0) 
+        Client(SocketPtr s, const ServerConfig& config) 
+        : socket(s), errorCount(0), heartbeat(&config.heartbeat)
+        , messageBudget(config.messageRatePerClient, config.messageBurstPerClient)
+        , byteBudget(config.byteRatePerClient, config.byteBurstPerClient)
+        , hasPending(false), throttled(false), datagramToken(0), datagramKnown(false)
         { clientID = generateID(); }
 
         ClientID   clientID;
         SocketPtr  socket;
         int        errorCount;
+        Heartbeat  heartbeat;
+
+        TokenBucket messageBudget;
+        TokenBucket byteBudget;
+        std::string pending;    // received frame waiting for its turn in dispatch()
+        bool        hasPending;
+        bool        throttled;  // not read from until its budget recovered
+
+        // We do not read from the client, its pongs cannot arrive meanwhile
+        auto held() const -> bool { return hasPending || throttled; }
+
+        uint64_t             datagramToken;
+        DatagramIO::Endpoint datagramEndpoint;
+        bool                 datagramKnown;
+    };
+
+    struct ConnectionRate
+    {
+        TokenBucket                      bucket;
+        std::list<std::string>::iterator order;
     };
 
 
 public:
 
-    Impl(Server* parent, unsigned port);
+    Impl(Server* parent, const Endpoint& endpoint, const ServerConfig& config);
     ~Impl();
 
     void poll();
 
     void send(const std::string&);
     void send(const std::string&, ClientID);
+    void sendUnreliable(const std::string&);
+    void sendUnreliable(const std::string&, ClientID);
     auto connectionCount() const -> size_t;
 
+    auto startRecording(const std::string& path) -> bool { return _recorder.open(path); }
+    void stopRecording()                                 { _recorder.close(); }
+
 private:
 
     void connectionCount(size_t c)                  { _parent->_connectionCount(c); }
-    void dataReceived(std::string s, ClientID c)    { _parent->_dataReceived(s, c); }
+    void dataReceived(const std::string& s, ClientID c);
     void errorEmitted(std::string e)                { _parent->_errorEmitted(e); }
 
     void accept();
-    void onDataReceived(SocketPtr socket, const std::string& data);
+    void retryAccept();
+    bool admit(SocketPtr socket);
+    bool admitAddress(SocketPtr socket);
+    bool acceptingAllowed() const;
+    void armHeartbeat();
+    void checkHeartbeat(SocketPtr);
+    void onDataReceived(SocketPtr socket, std::string data);
+    void dispatch();
+    void consumeBudget(Client&, size_t size, TokenBucket::TimePoint now);
+    auto budgetDelay(const Client&, TokenBucket::TimePoint now) const -> TokenBucket::Clock::duration;
+    void resumeLater(SocketPtr socket, TokenBucket::TimePoint when);
+    void armThrottle();
+    void onHeartbeatReceived(SocketPtr socket);
+    void onReceiveProgress(SocketPtr socket);
+    void onDatagramReceived(const DatagramIO::Endpoint&, uint64_t token, const DatagramIO::Messages&);
     void onSocketDisconnected(SocketPtr socket);
+    void unexpectedFrame(SocketPtr socket, const std::string& error);
     void closeSocket(SocketPtr);
     void socketError(SocketPtr);
+    auto findClient(ClientID) -> Client*;
+    void record(Recorder::Event, ClientID, const std::string& data = std::string());
+    auto newDatagramToken() -> uint64_t;
 
-    Server* _parent;
-    DataIO  _dataIO;
+    Server*      _parent;
+    ServerConfig _config;
+    DataIO       _dataIO;
 
     boost::asio::io_service        _ioService;
-    boost::asio::ip::tcp::acceptor _acceptor;
-    std::vector<Client>            _clients;
+    Acceptor                       _acceptor;
+    boost::asio::steady_timer      _acceptTimer;
+    boost::asio::steady_timer      _heartbeatTimer;
+    boost::asio::steady_timer      _throttleTimer;
+    bool                           _accepting;
+    bool                           _throttleArmed;
+    DatagramIO                     _datagramIO;
+    std::mt19937_64                _random;
+    Recorder                       _recorder;
+
+    std::unordered_map<SocketPtr, Client>           _clients;
+    std::unordered_map<ClientID, SocketPtr>         _clientIDs;
+    std::unordered_map<uint64_t, SocketPtr>         _datagramTokens;
+    std::unordered_map<std::string, ConnectionRate> _connectionRates;
+    std::list<std::string>                          _connectionRateOrder; // most recently seen address first
+    TimerWheel<std::weak_ptr<Socket>>               _heartbeatWheel;
+    TimerWheel<std::weak_ptr<Socket>>               _throttleWheel;
+    std::deque<SocketPtr>                           _ready; // clients with a pending frame, round-robin
 };
 
 
@@ -76,16 +178,46 @@ private:
 //--- Implementation
 //------------------------------------------------------------------------------
 
-Server::Impl::Impl(Server* parent, unsigned port)
+Server::Impl::Impl(Server* parent, const Endpoint& endpoint, const ServerConfig& config)
 : _parent(parent)
-, _acceptor(_ioService, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port))
+, _config(config)
+, _acceptor(_ioService, endpoint)
+, _acceptTimer(_ioService)
+, _heartbeatTimer(_ioService)
+, _throttleTimer(_ioService)
+, _accepting(false)
+, _throttleArmed(false)
+, _datagramIO(_ioService)
+, _heartbeatWheel(cfg::timerWheelTick, cfg::timerWheelSlots)
+, _throttleWheel(cfg::throttleTick, cfg::throttleSlots)
 {
-    _dataIO.connectSocketDisconnect([this](SocketPtr socket)                { onSocketDisconnected(socket); });
-    _dataIO.connectDataReceived([this](SocketPtr socket, std::string data)  { onDataReceived(socket, data); });
-    _dataIO.connectErrorEmitted([this](SocketPtr socket, std::string error) { socketError(socket); errorEmitted(error); });
-
-    _acceptor.listen();
+    _dataIO.setSocketDisconnectHandler([this](SocketPtr socket)                { onSocketDisconnected(socket); });
+    _dataIO.setDataReceivedHandler([this](SocketPtr socket, std::string data)  { onDataReceived(socket, std::move(data)); });
+    _dataIO.setHeartbeatReceivedHandler([this](SocketPtr socket)               { onHeartbeatReceived(socket); });
+    _dataIO.setReceiveProgressHandler([this](SocketPtr socket)                 { onReceiveProgress(socket); });
+    _dataIO.setErrorEmittedHandler([this](SocketPtr socket, std::string error) { socketError(socket); errorEmitted(error); });
+    _dataIO.setDatagramTokenReceivedHandler([this](SocketPtr socket, uint64_t)   { unexpectedFrame(socket, "Server: token frame from a client"); });
+    _dataIO.setDatagramAckReceivedHandler([this](SocketPtr socket)               { unexpectedFrame(socket, "Server: datagram ack from a client"); });
+
+    _datagramIO.setDataReceivedHandler([this](const DatagramIO::Endpoint& endpoint, uint64_t token, const DatagramIO::Messages& messages)
+                                    { onDatagramReceived(endpoint, token, messages); });
+    _datagramIO.setErrorEmittedHandler([this](std::string error) { errorEmitted(error); });
+
+    _acceptor.listen(_config.listenBacklog);
+    _acceptor.non_blocking(true);
     accept();
+
+    DatagramIO::Endpoint local;
+    if (_config.datagrams && toDatagramEndpoint(_acceptor.local_endpoint(), local))
+    {
+        std::random_device seed;
+        _random.seed((static_cast<uint64_t>(seed()) << 32) ^ seed());
+        _datagramIO.open(local);
+        _datagramIO.listen();
+    }
+
+    if (Heartbeat(&_config.heartbeat).enabled())
+        armHeartbeat();
 }
 
 //------------------------------------------------------------------------------
@@ -94,7 +226,13 @@ Server::Impl::~Impl()
 {
     _acceptor.cancel();
     _acceptor.close();
-    for (auto c : _clients) closeSocket(c.socket);
+    _acceptTimer.cancel();
+    _heartbeatTimer.cancel();
+    _throttleTimer.cancel();
+    _datagramIO.close();
+
+    auto clients = std::move(_clients);
+    for (auto& c : clients) closeSocket(c.first);
 }
 
 //------------------------------------------------------------------------------
@@ -102,6 +240,7 @@ Server::Impl::~Impl()
 void Server::Impl::poll() 
 { 
     _ioService.poll_one(); 
+    dispatch();
 }
 
 //---------------------------------------------------------------------
@@ -113,28 +252,46 @@ size_t Server::Impl::connectionCount() const
 
 //------------------------------------------------------------------------------
 
+void Server::Impl::dataReceived(const std::string& data, ClientID id)
+{
+    // A plain flag, signal::empty() would lock the signal for every message
+    if (_parent->_dataHandler) _parent->_dataHandler(data, id);
+    if (_parent->_dataSlots)   _parent->_dataReceived(data, id);
+}
+
+//------------------------------------------------------------------------------
+
 void Server::Impl::closeSocket(SocketPtr socket)
 {
     boost::system::error_code ec;
-    socket->cancel();
-    socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
-    socket->close();
+    socket->cancel(ec);
+    socket->shutdown(boost::asio::socket_base::shutdown_both, ec);
+    socket->close(ec);
+
+    auto it = _clients.find(socket);
+    if (it != _clients.end())
+    {
+        record(Recorder::EVENT_DISCONNECT, it->second.clientID);
+        _clientIDs.erase(it->second.clientID);
+        _datagramTokens.erase(it->second.datagramToken);
+        _datagramIO.removeToken(it->second.datagramToken);
+        _clients.erase(it);
+    }
 
-    auto newEnd = std::remove_if(_clients.begin(), _clients.end(),
-                                 [socket](const Client& c){ return c.socket == socket; });
-    _clients.erase(newEnd, _clients.end());
+    // Resume accepting in case we were at the connection limit
+    accept();
 }
 
 //------------------------------------------------------------------------------
 
 void Server::Impl::socketError(SocketPtr socket)
 {
-    auto it = std::find_if(_clients.begin(), _clients.end(), [socket](const Client& c){ return c.socket == socket; });
+    auto it = _clients.find(socket);
     if (it != _clients.end())
     {
-        if (++it->errorCount > cfg::failtureCountForDisconnect)
+        if (++it->second.errorCount > cfg::failtureCountForDisconnect)
         {
-            closeSocket(it->socket);
+            closeSocket(socket);
             connectionCount(connectionCount()); 
         }
     }
@@ -142,32 +299,167 @@ void Server::Impl::socketError(SocketPtr socket)
 
 //------------------------------------------------------------------------------
 
+bool Server::Impl::acceptingAllowed() const
+{
+    return _acceptor.is_open() 
+        && (_config.maxConnections == 0 || _clients.size() < _config.maxConnections);
+}
+
+//------------------------------------------------------------------------------
+
 void Server::Impl::accept()
 {
-    SocketPtr socket = std::make_shared<boost::asio::ip::tcp::socket>(_ioService);
+    // While at the connection limit, new connections wait in the listen backlog 
+    // and accepting resumes as soon as a client is closed
+    if (_accepting || !acceptingAllowed())
+        return;
+
+    _accepting = true;
+    SocketPtr socket = std::make_shared<Socket>(_ioService);
 
     _acceptor.async_accept(*socket, [socket,this](boost::system::error_code error)
     {
-        if (!error) {
-            _clients.push_back( Client(socket) );
-            connectionCount(connectionCount()); 
-        }
-        else {
+        _accepting = false;
+        if (error == boost::asio::error::operation_aborted)
+            return;
+
+        if (error) {
+            // e.g. out of file descriptors, back off instead of spinning on the error
             errorEmitted("Server: Error async_accept");
+            retryAccept();
+            return;
+        }
+
+        auto admitted = admit(socket);
+
+        // Drain connections that are already pending without another loop turn
+        for (size_t i = 1; i < _config.acceptBatch && acceptingAllowed(); ++i)
+        {
+            auto next = std::make_shared<Socket>(_ioService);
+            boost::system::error_code ec;
+            _acceptor.accept(*next, ec);
+            if (ec) 
+                break;
+
+            admitted = admit(next) || admitted;
         }
 
-        _dataIO.listen(socket);
+        if (admitted)
+            connectionCount(connectionCount()); 
+
         accept();
     });
 }
 
 //------------------------------------------------------------------------------
 
+void Server::Impl::retryAccept()
+{
+    _accepting = true;
+    _acceptTimer.expires_from_now(cfg::acceptRetryDelay);
+    _acceptTimer.async_wait([this](const boost::system::error_code& ec)
+    {
+        _accepting = false;
+        if (!ec)
+            accept();
+    });
+}
+
+//------------------------------------------------------------------------------
+
+bool Server::Impl::admit(SocketPtr socket)
+{
+    if (!admitAddress(socket))
+    {
+        errorEmitted("Server: connection rate limit exceeded");
+        boost::system::error_code ec;
+        socket->close(ec);
+        return false;
+    }
+
+    auto& client = _clients.emplace(socket, Client(socket, _config)).first->second;
+    _clientIDs[client.clientID] = socket;
+    record(Recorder::EVENT_CONNECT, client.clientID);
+
+    if (client.heartbeat.enabled())
+        _heartbeatWheel.schedule(socket, client.heartbeat.nextDeadline());
+
+    if (_datagramIO.isOpen())
+    {
+        client.datagramToken = newDatagramToken();
+        _datagramTokens[client.datagramToken] = socket;
+        _datagramIO.addToken(client.datagramToken);
+        _dataIO.sendDatagramToken(socket, client.datagramToken);
+    }
+
+    _dataIO.listen(socket);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+uint64_t Server::Impl::newDatagramToken()
+{
+    // Random, so other hosts cannot inject datagrams by guessing a ClientID
+    uint64_t token = 0;
+    while (token == 0 || _datagramTokens.count(token))
+        token = _random();
+    return token;
+}
+
+//------------------------------------------------------------------------------
+
+bool Server::Impl::admitAddress(SocketPtr socket)
+{
+    if (_config.connectionRatePerIP <= 0)
+        return true;
+
+    boost::system::error_code ec;
+    auto remote = socket->remote_endpoint(ec);
+    if (ec)
+        return false;
+
+    // Local (AF_UNIX) peers are on this host and not limited per address
+    DatagramIO::Endpoint endpoint;
+    if (!toDatagramEndpoint(remote, endpoint))
+        return true;
+
+    auto address = endpoint.address().to_string();
+    auto it      = _connectionRates.find(address);
+    if (it == _connectionRates.end())
+    {
+        // The table is bounded, the address not seen for the longest time is forgotten
+        if (_connectionRates.size() >= cfg::rateTableSize)
+        {
+            _connectionRates.erase(_connectionRateOrder.back());
+            _connectionRateOrder.pop_back();
+        }
+
+        _connectionRateOrder.push_front(address);
+        auto rate = ConnectionRate{ TokenBucket(_config.connectionRatePerIP, _config.connectionBurstPerIP),
+                                    _connectionRateOrder.begin() };
+        it = _connectionRates.emplace(std::move(address), rate).first;
+    }
+    else
+    {
+        _connectionRateOrder.splice(_connectionRateOrder.begin(), _connectionRateOrder, it->second.order);
+    }
+
+    return it->second.bucket.consume(1.0);
+}
+
+//------------------------------------------------------------------------------
+
 void Server::Impl::send(const std::string& data)
 {
+    if (!frame::validDataSize(data.size())) {
+        errorEmitted("Server: invalid message size");
+        return;
+    }
+
     for (auto& c : _clients)
     {
-        _dataIO.send(c.socket, data);
+        _dataIO.send(c.first, data);
     }
 }
 
@@ -175,28 +467,287 @@ void Server::Impl::send(const std::string& data)
 
 void Server::Impl::send(const std::string& data, ClientID id)
 {
-    auto it = std::find_if(_clients.begin(), _clients.end(), [id](const Client& c){ return c.clientID == id; });
-    if (it != _clients.end()) 
+    if (!frame::validDataSize(data.size())) {
+        errorEmitted("Server: invalid message size");
+        return;
+    }
+
+    if (auto client = findClient(id)) 
+    {
+        _dataIO.send(client->socket, data);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void Server::Impl::sendUnreliable(const std::string& data)
+{
+    for (auto& c : _clients)
     {
-        _dataIO.send(it->socket, data);
+        if (c.second.datagramKnown)
+            _datagramIO.send(c.second.datagramEndpoint, c.second.datagramToken, data);
     }
 }
 
 //------------------------------------------------------------------------------
 
-void Server::Impl::onDataReceived(SocketPtr socket, const std::string& data)
+void Server::Impl::sendUnreliable(const std::string& data, ClientID id)
 {
-    auto it = std::find_if(_clients.begin(), _clients.end(), [socket](const Client& c){ return c.socket == socket; });
-    if (it != _clients.end()) 
+    auto client = findClient(id);
+    if (client && client->datagramKnown) 
     {
-        it->errorCount = 0;
-        dataReceived(data, it->clientID);
+        _datagramIO.send(client->datagramEndpoint, client->datagramToken, data);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+Server::Impl::Client* Server::Impl::findClient(ClientID id)
+{
+    auto it = _clientIDs.find(id);
+    if (it == _clientIDs.end())
+        return nullptr;
+
+    auto client = _clients.find(it->second);
+    return client != _clients.end() ? &client->second : nullptr;
+}
+
+//------------------------------------------------------------------------------
+
+void Server::Impl::onDataReceived(SocketPtr socket, std::string data)
+{
+    auto it = _clients.find(socket);
+    if (it == _clients.end()) 
+        return;
+
+    auto& client = it->second;
+    client.errorCount = 0;
+    client.heartbeat.frameReceived(true);
+    record(Recorder::EVENT_DATA, client.clientID, data);
+
+    // Handed to the application by dispatch() in round-robin order. The next frame
+    // of this client is not read before, so a chatty client cannot get ahead of others.
+    client.pending    = std::move(data);
+    client.hasPending = true;
+    _ready.push_back(socket);
+}
+
+//------------------------------------------------------------------------------
+
+void Server::Impl::dispatch()
+{
+    while (!_ready.empty())
+    {
+        auto socket = std::move(_ready.front());
+        _ready.pop_front();
+
+        auto it = _clients.find(socket);
+        if (it == _clients.end() || !it->second.hasPending)
+            continue;
+
+        auto& client = it->second;
+        auto  data   = std::move(client.pending);
+        auto  id     = client.clientID;
+        client.pending.clear();
+        client.hasPending = false;
+
+        // Read on right away, or once the client's budget recovered
+        auto now = TokenBucket::Clock::now();
+        consumeBudget(client, data.size(), now);
+        auto delay = budgetDelay(client, now);
+        if (delay == TokenBucket::Clock::duration::zero())
+            _dataIO.listen(socket);
+        else
+            resumeLater(socket, now + delay);
+
+        dataReceived(data, id);
+        return;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void Server::Impl::consumeBudget(Client& client, size_t size, TokenBucket::TimePoint now)
+{
+    if (_config.messageRatePerClient > 0) client.messageBudget.take(1.0, now);
+    if (_config.byteRatePerClient > 0)    client.byteBudget.take(static_cast<double>(size), now);
+}
+
+//------------------------------------------------------------------------------
+
+TokenBucket::Clock::duration Server::Impl::budgetDelay(const Client& client, TokenBucket::TimePoint now) const
+{
+    auto delay = TokenBucket::Clock::duration::zero();
+    if (_config.messageRatePerClient > 0) delay = std::max(delay, client.messageBudget.delay(now));
+    if (_config.byteRatePerClient > 0)    delay = std::max(delay, client.byteBudget.delay(now));
+    return delay;
+}
+
+//------------------------------------------------------------------------------
+
+void Server::Impl::resumeLater(SocketPtr socket, TokenBucket::TimePoint when)
+{
+    _clients.at(socket).throttled = true;
+    _throttleWheel.schedule(socket, when);
+    if (!_throttleArmed)
+        armThrottle();
+}
+
+//------------------------------------------------------------------------------
+
+void Server::Impl::armThrottle()
+{
+    _throttleArmed = true;
+    _throttleTimer.expires_from_now(_throttleWheel.tick());
+    _throttleTimer.async_wait([this](const boost::system::error_code& ec)
+    {
+        _throttleArmed = false;
+        if (ec) 
+            return;
+
+        _throttleWheel.advance(std::chrono::steady_clock::now(), [this](const std::weak_ptr<Socket>& s)
+        {
+            auto socket = s.lock();
+            auto it     = socket ? _clients.find(socket) : _clients.end();
+            if (it != _clients.end())
+            {
+                it->second.throttled = false;
+                _dataIO.listen(socket);
+            }
+        });
+
+        if (!_throttleWheel.empty())
+            armThrottle();
+    });
+}
+
+//------------------------------------------------------------------------------
+
+void Server::Impl::onHeartbeatReceived(SocketPtr socket)
+{
+    auto it = _clients.find(socket);
+    if (it != _clients.end())
+    {
+        it->second.errorCount = 0;
+        it->second.heartbeat.frameReceived(false);
     }
     _dataIO.listen(socket);
 }
 
 //------------------------------------------------------------------------------
 
+void Server::Impl::onReceiveProgress(SocketPtr socket)
+{
+    auto it = _clients.find(socket);
+    if (it != _clients.end())
+        it->second.heartbeat.frameReceived(false);
+}
+
+//------------------------------------------------------------------------------
+
+void Server::Impl::record(Recorder::Event event, ClientID id, const std::string& data)
+{
+    if (_recorder.isOpen() && !_recorder.record(event, id, data))
+        errorEmitted("Server: writing the capture failed, recording stopped");
+}
+
+//------------------------------------------------------------------------------
+
+void Server::Impl::onDatagramReceived(const DatagramIO::Endpoint& endpoint, uint64_t token, const DatagramIO::Messages& messages)
+{
+    auto socket = _datagramTokens.find(token);
+    if (socket == _datagramTokens.end())
+        return;
+
+    auto it = _clients.find(socket->second);
+    if (it == _clients.end())
+        return;
+
+    auto& client = it->second;
+
+    // The client repeats its announcement until it is acknowledged
+    if (!client.datagramKnown)
+        _dataIO.sendDatagramAck(client.socket);
+
+    // The client announces its endpoint with every datagram, follow it if it changes (e.g. NAT rebinding)
+    client.datagramEndpoint = endpoint;
+    client.datagramKnown    = true;
+
+    auto  id     = client.clientID;
+    auto  now    = TokenBucket::Clock::now();
+    for (auto& m : messages)
+    {
+        // Nothing to hold back with datagrams, whatever exceeds the budget is lost
+        if (budgetDelay(client, now) != TokenBucket::Clock::duration::zero())
+            return;
+
+        consumeBudget(client, m.size(), now);
+        record(Recorder::EVENT_DATAGRAM, id, m);
+        dataReceived(m, id);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void Server::Impl::armHeartbeat()
+{
+    _heartbeatTimer.expires_from_now(_heartbeatWheel.tick());
+    _heartbeatTimer.async_wait([this](const boost::system::error_code& ec)
+    {
+        if (ec) 
+            return;
+
+        _heartbeatWheel.advance(std::chrono::steady_clock::now(), 
+                                [this](const std::weak_ptr<Socket>& s) { checkHeartbeat(s.lock()); });
+        armHeartbeat();
+    });
+}
+
+//------------------------------------------------------------------------------
+
+void Server::Impl::checkHeartbeat(SocketPtr socket)
+{
+    auto it = _clients.find(socket);
+    if (!socket || it == _clients.end())
+        return;
+
+    auto& heartbeat = it->second.heartbeat;
+    auto  now       = std::chrono::steady_clock::now();
+
+    // The silence of a held client is ours: do not time it out, but keep pinging
+    // it so the client in turn keeps hearing from us
+    if (it->second.held())
+    {
+        heartbeat.frameReceived(false);
+        if (_config.heartbeat.interval.count() > 0)
+            _dataIO.ping(socket);
+
+        _heartbeatWheel.schedule(socket, std::max(heartbeat.nextDeadline(), now + _heartbeatWheel.tick()));
+        return;
+    }
+
+    switch (heartbeat.check(now))
+    {
+    case Heartbeat::ACTION_IDLE_TIMEOUT:
+        errorEmitted("Server: client idle timeout");
+        onSocketDisconnected(socket);
+        return;
+    case Heartbeat::ACTION_READ_TIMEOUT:
+        errorEmitted("Server: client heartbeat timeout");
+        onSocketDisconnected(socket);
+        return;
+    case Heartbeat::ACTION_PING:
+        _dataIO.ping(socket);
+        break;
+    case Heartbeat::ACTION_NONE:
+        break;
+    }
+
+    _heartbeatWheel.schedule(socket, heartbeat.nextDeadline());
+}
+
+//------------------------------------------------------------------------------
+
 void Server::Impl::onSocketDisconnected(SocketPtr socket)
 {
     closeSocket(socket);
@@ -204,24 +755,66 @@ void Server::Impl::onSocketDisconnected(SocketPtr socket)
 }
 
 
+//------------------------------------------------------------------------------
+
+void Server::Impl::unexpectedFrame(SocketPtr socket, const std::string& error)
+{
+    // Only servers send these frames, a client sending one is broken or hostile
+    errorEmitted(error);
+    onSocketDisconnected(socket);
+}
+
+
 //------------------------------------------------------------------------------
 //--- Server
 //------------------------------------------------------------------------------
 
-Server::Server(unsigned port)
+Server::Server(unsigned port, ServerConfig config)
 : _impl(nullptr)
 , _port(port)
+, _config(config)
+, _dataSlots(false)
 {}
 
 Server::~Server() { stop(); }
 
-void Server::start()                                    { if (!_impl) _impl.reset(new Impl(this, _port)); }
-void Server::stop()                                     { _impl.reset(nullptr); }
+void Server::start()
+{
+    using namespace boost::asio::ip;
+    if (!_impl) _impl.reset(new Impl(this, tcp::endpoint(tcp::v4(), _port), _config));
+}
+
+void Server::startLocal(std::string path)
+{
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    using namespace boost::asio::local;
+    if (_impl) 
+        return;
+
+    removeStaleSocket(path);
+    _impl.reset(new Impl(this, stream_protocol::endpoint(path), _config));
+    _localPath = path; // only a successfully bound socket is ours to remove in stop()
+#else
+    _errorEmitted("Server: local sockets are not supported on this platform");
+#endif
+}
+
+void Server::stop()
+{
+    _impl.reset(nullptr);
+    if (!_localPath.empty()) std::remove(_localPath.c_str());
+    _localPath.clear();
+}
+
 
 void Server::send(const std::string& data)              { if (_impl) _impl->send(data); }
 void Server::send(const std::string& data, ClientID id) { if (_impl) _impl->send(data, id); }
+void Server::sendUnreliable(const std::string& data)    { if (_impl) _impl->sendUnreliable(data); }
+void Server::sendUnreliable(const std::string& data, ClientID id) { if (_impl) _impl->sendUnreliable(data, id); }
 void Server::poll()                                     { if (_impl) _impl->poll();  }
 auto Server::started()         const -> bool            { return _impl != nullptr;       }
+auto Server::startRecording(std::string path) -> bool   { return _impl ? _impl->startRecording(path) : false; }
+void Server::stopRecording()                            { if (_impl) _impl->stopRecording(); }
 auto Server::connectionCount() const -> size_t          { return _impl ? _impl->connectionCount() : 0; }
 
 //------------------------------------------------------------------------------
@@ -233,7 +826,10 @@ Server::Connection Server::connectErrorEmitted(const std::function<void(std::str
 { return _errorEmitted.connect(handler); }
 
 Server::Connection Server::connectDataReceived(const std::function<void(std::string, ClientID)> handler) 
-{ return _dataReceived.connect(handler); }
+{ _dataSlots = true; return _dataReceived.connect(handler); }
+
+void Server::setDataReceivedHandler(DataHandler handler)
+{ _dataHandler = std::move(handler); }
 
 //------------------------------------------------------------------------------
 
@@ -13,6 +13,7 @@
 //  You should have received a copy of the GNU General Public License
 //  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
+#include "Common.h"
 
 #include <boost/signals2.hpp>
 
@@ -32,39 +33,61 @@ class Server
     using Connection = boost::signals2::connection;
 
 public:
-    Server(unsigned port);
+    using DataHandler = std::function<void(const std::string&, ClientID)>;
+
+    Server(unsigned port, ServerConfig config = ServerConfig());
     ~Server();
 
     // Run processing loop and execute read handler
     void poll();
 
-    // Start/Stop the Server
+    // Start/Stop the Server, startLocal listens on a unix domain socket for same-host clients
     void start();
+    void startLocal(std::string path);
     void stop();
 
     auto started()         const -> bool;
     auto connectionCount() const -> size_t;
 
+    // Capture connects, disconnects and received messages of all clients to a 
+    // file for NetworkLib_replay (see Recorder.h). Needs a started server.
+    auto startRecording(std::string path) -> bool;
+    void stopRecording();
+
     // Send data to the clients
     void send(const std::string& data); // broadcast
     void send(const std::string& data, ClientID clientID);
 
+    // Send data over the datagram channel (see ServerConfig::datagrams). Messages 
+    // may be lost and older messages are dropped by the receiver, so use it for
+    // state where only the latest value matters. 
+    void sendUnreliable(const std::string& data); // broadcast
+    void sendUnreliable(const std::string& data, ClientID clientID);
+
     // Callbacks
     Connection connectConnectionCount(const std::function<void(size_t)>);
     Connection connectDataReceived(const std::function<void(std::string, ClientID)>);
     Connection connectErrorEmitted(const std::function<void(std::string)>);
 
+    // Fast path for received data: a single handler (replaces the previous one) without
+    // signal dispatch and string copy. Called before the connectDataReceived slots.
+    void setDataReceivedHandler(DataHandler);
+
 
 private:
 
     class Impl; friend Impl;
     std::unique_ptr<Impl> _impl;
 
-    unsigned _port;
+    unsigned     _port;
+    std::string  _localPath;
+    ServerConfig _config;
 
     boost::signals2::signal<void(size_t)>                _connectionCount;
     boost::signals2::signal<void(std::string, ClientID)> _dataReceived;
     boost::signals2::signal<void(std::string)>           _errorEmitted;
+    DataHandler                                          _dataHandler;
+    bool                                                 _dataSlots; // connectDataReceived was called
 };
 
 //------------------------------------------------------------------------------
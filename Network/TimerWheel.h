@@ -0,0 +1,109 @@
+// Copyright (c) 2017  Mathias Roder (teuse@mailbox.org)
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+
+namespace network {
+
+//------------------------------------------------------------------------------
+
+// Hashed timing wheel: many timeouts driven by a single asio timer.
+// Scheduling is O(1) and entries are never cancelled; the owner re-checks the
+// state of a key when its entry fires and simply schedules it again if needed.
+template <typename Key>
+class TimerWheel
+{
+public:
+    using Clock     = std::chrono::steady_clock;
+    using TimePoint = Clock::time_point;
+    using Duration  = Clock::duration;
+
+    TimerWheel(Duration tick, size_t slotCount)
+    : _tick(tick)
+    , _slots(std::max<size_t>(slotCount, 1))
+    , _start(Clock::now())
+    , _current(0)
+    , _size(0)
+    {}
+
+    auto tick()  const -> Duration { return _tick; }
+    auto empty() const -> bool     { return _size == 0; }
+
+    void schedule(Key key, TimePoint deadline)
+    {
+        auto t = std::max(ticks(deadline), _current);
+        _slots[t % _slots.size()].push_back(Entry{ std::move(key), deadline });
+        ++_size;
+    }
+
+    // Call handler(key) for every entry whose tick has fully elapsed at 'now',
+    // i.e. entries fire at most one tick after their deadline
+    template <typename Handler>
+    void advance(TimePoint now, Handler handler)
+    {
+        auto target = ticks(now);
+        if (target <= _current)
+            return;
+
+        auto steps = std::min<uint64_t>(target - _current, _slots.size());
+
+        std::vector<Entry> due;
+        for (uint64_t i = 0; i < steps; ++i)
+        {
+            auto& slot = _slots[(_current + i) % _slots.size()];
+            auto  mid  = std::partition(slot.begin(), slot.end(),
+                                        [now](const Entry& e){ return e.deadline > now; });
+            std::move(mid, slot.end(), std::back_inserter(due));
+            slot.erase(mid, slot.end());
+        }
+
+        // Handlers may schedule again, so the wheel must already point to 'now'
+        _current = target;
+        _size   -= due.size();
+
+        for (auto& e : due)
+            handler(e.key);
+    }
+
+private:
+
+    struct Entry
+    {
+        Key       key;
+        TimePoint deadline;
+    };
+
+    auto ticks(TimePoint tp) const -> uint64_t
+    {
+        return tp <= _start ? 0 : static_cast<uint64_t>((tp - _start) / _tick);
+    }
+
+    Duration                        _tick;
+    std::vector<std::vector<Entry>> _slots;
+    TimePoint                       _start;
+    uint64_t                        _current;
+    size_t                          _size;
+};
+
+//------------------------------------------------------------------------------
+
+}
@@ -0,0 +1,87 @@
+// Copyright (c) 2017  Mathias Roder (teuse@mailbox.org)
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+
+
+namespace network {
+
+//------------------------------------------------------------------------------
+
+// Classic token bucket: refills with 'rate' tokens per second up to 'burst'
+class TokenBucket
+{
+public:
+    using Clock     = std::chrono::steady_clock;
+    using TimePoint = Clock::time_point;
+
+    TokenBucket(double rate, double burst)
+    : _rate(rate)
+    , _burst(burst)
+    , _tokens(burst)
+    , _last(Clock::now())
+    {}
+
+    auto consume(double amount, TimePoint now = Clock::now()) -> bool
+    {
+        refill(now);
+        if (_tokens < amount)
+            return false;
+
+        _tokens -= amount;
+        return true;
+    }
+
+    // Take tokens even if that puts the bucket into debt, see delay()
+    void take(double amount, TimePoint now = Clock::now())
+    {
+        refill(now);
+        _tokens -= amount;
+    }
+
+    // Time until the bucket is out of debt again
+    auto delay(TimePoint now = Clock::now()) const -> Clock::duration
+    {
+        auto tokens = _tokens + elapsedSeconds(now) * _rate;
+        if (tokens >= 0 || _rate <= 0)
+            return Clock::duration::zero();
+
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(-tokens / _rate));
+    }
+
+private:
+
+    void refill(TimePoint now)
+    {
+        _tokens = std::min(_burst, _tokens + elapsedSeconds(now) * _rate);
+        _last   = now;
+    }
+
+    auto elapsedSeconds(TimePoint now) const -> double
+    {
+        return std::chrono::duration<double>(now - _last).count();
+    }
+
+    double    _rate;
+    double    _burst;
+    double    _tokens;
+    TimePoint _last;
+};
+
+//------------------------------------------------------------------------------
+
+}
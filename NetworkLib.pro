@@ -18,11 +18,21 @@ INCLUDEPATH += $$_PRO_FILE_PWD_
 HEADERS += Network/Client.h \
            Network/Server.h \
            Network/DataIO.h \
+           Network/DatagramIO.h \
+           Network/Frame.h \
+           Network/Recorder.h \
+           Network/Heartbeat.h \
+           Network/TimerWheel.h \
+           Network/TokenBucket.h \
            Network/Common.h
 
 SOURCES += Network/Client.cpp \
            Network/Server.cpp \
-           Network/DataIO.cpp
+           Network/DataIO.cpp \
+           Network/DatagramIO.cpp \
+           Network/Frame.cpp \
+           Network/Recorder.cpp \
+           Network/Heartbeat.cpp
             
 
 # ------------------------------------------------------------------------------
@@ -0,0 +1,224 @@
+// Copyright (c) 2017  Mathias Roder (teuse@mailbox.org)
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Fuzz target for the frame decoder. Built with NETWORKLIB_LIBFUZZER it is a
+// libFuzzer target, otherwise a standalone driver that runs the given input 
+// files or, without arguments, a deterministic set of mutated frames.
+//
+// Checks that
+//  - parseHeader accepts nothing but well-formed headers with a bounded size,
+//  - DataIO decodes any byte stream without crashing, delivers only frames
+//    within cfg::maxMessageSize and terminates once the stream ends.
+
+#include <Network/Common.h>
+#include <Network/DataIO.h>
+#include <Network/Frame.h>
+
+#include <boost/asio.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+void check(bool condition, const char* what)
+{
+    if (!condition)
+    {
+        std::cerr << "check failed: " << what << std::endl;
+        std::abort();
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void fuzzHeader(const char* data, size_t size)
+{
+    using namespace network;
+
+    auto header = frame::parseHeader(data, size);
+    if (size != frame::headerLength)
+    {
+        check(header.type == frame::TYPE_INVALID, "header of wrong length accepted");
+        return;
+    }
+
+    if (header.type == frame::TYPE_DATA)
+    {
+        check(header.size > 0 && header.size <= cfg::maxMessageSize, "data size out of bounds");
+
+        auto encoded = frame::dataHeader(header.size);
+        auto decoded = frame::parseHeader(encoded.data(), encoded.size());
+        check(decoded.type == frame::TYPE_DATA && decoded.size == header.size, "header does not round-trip");
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void fuzzStream(const char* data, size_t size)
+{
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    using namespace boost::asio;
+    using Socket = generic::stream_protocol::socket;
+
+    io_service ioService;
+    local::stream_protocol::socket writer(ioService), reader(ioService);
+    local::connect_pair(writer, reader);
+
+    auto socket = std::make_shared<Socket>(ioService, generic::stream_protocol(AF_UNIX, 0), reader.release());
+
+    network::DataIO dataIO;
+    bool   closed = false;
+    size_t frames = 0;
+
+    dataIO.setSocketDisconnectHandler([&](std::shared_ptr<Socket>)             { closed = true; });
+    dataIO.setErrorEmittedHandler([&](std::shared_ptr<Socket>, std::string)    { closed = true; });
+    dataIO.setHeartbeatReceivedHandler([&](std::shared_ptr<Socket> s)          { ++frames; dataIO.listen(s); });
+    dataIO.setDatagramTokenReceivedHandler([&](std::shared_ptr<Socket> s, uint64_t) { ++frames; dataIO.listen(s); });
+    dataIO.setDatagramAckReceivedHandler([&](std::shared_ptr<Socket> s)        { ++frames; dataIO.listen(s); });
+    dataIO.setDataReceivedHandler([&](std::shared_ptr<Socket> s, std::string d)
+    {
+        check(!d.empty() && d.size() <= network::cfg::maxMessageSize, "delivered frame out of bounds");
+        ++frames;
+        dataIO.listen(s);
+    });
+
+    // Pongs are written back into the pair, keep reading them so the writer never blocks
+    std::vector<char> sink(4096);
+    std::function<void()> drain = [&]
+    {
+        writer.async_read_some(buffer(sink), [&](const boost::system::error_code& ec, size_t) { if (!ec) drain(); });
+    };
+    drain();
+
+    async_write(writer, buffer(data, size), [&](const boost::system::error_code&, size_t)
+    {
+        boost::system::error_code ec;
+        writer.shutdown(socket_base::shutdown_send, ec);
+    });
+
+    dataIO.listen(socket);
+    while (!closed && ioService.run_one())
+        ;
+
+    check(closed, "decoder did not terminate at the end of the stream");
+    check(frames <= size, "more frames than input bytes");
+
+    boost::system::error_code ec;
+    socket->close(ec);
+    writer.close(ec);
+    ioService.run();
+#else
+    (void)data; (void)size;
+#endif
+}
+
+//------------------------------------------------------------------------------
+
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    auto chars = reinterpret_cast<const char*>(data);
+    fuzzHeader(chars, std::min(size, network::frame::headerLength));
+    fuzzHeader(chars, size);
+    fuzzStream(chars, size);
+    return 0;
+}
+
+#if !defined(NETWORKLIB_LIBFUZZER)
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+// Valid frames with a few random mutations, deterministic for a given seed
+std::string mutatedStream(std::mt19937& random)
+{
+    using namespace network;
+
+    std::string stream;
+    std::uniform_int_distribution<int> kind(0, 4), byte(0, 255);
+    std::uniform_int_distribution<size_t> length(1, 300);
+
+    for (int i = 0, n = 1 + random() % 8; i < n; ++i)
+    {
+        switch (kind(random))
+        {
+        case 0:  stream += frame::pingFrame();  break;
+        case 1:  stream += frame::pongFrame();  break;
+        case 2:  stream += frame::tokenFrame(random()); break;
+        case 3:  stream += frame::datagramAckFrame(); break;
+        default: 
+            auto size = length(random);
+            stream += frame::dataHeader(size) + std::string(size, 'x');
+        }
+    }
+
+    for (int i = 0, n = random() % 4; i < n && !stream.empty(); ++i)
+        stream[random() % stream.size()] = static_cast<char>(byte(random));
+
+    if (random() % 4 == 0)
+        stream.resize(random() % (stream.size() + 1));
+
+    return stream;
+}
+
+//------------------------------------------------------------------------------
+
+}
+
+int main(int argc, char** argv)
+{
+    auto run = [](const std::string& input)
+    {
+        LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(input.data()), input.size());
+    };
+
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::ifstream file(argv[i], std::ios::binary);
+            run(std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()));
+        }
+        std::cout << "OK: " << (argc - 1) << " inputs" << std::endl;
+        return 0;
+    }
+
+    // Corner cases of the header parser, then random mutations
+    for (auto header : { "", "       0", "ffffffff", "   -0001", "  0x0010", " 1 2 3 4", "       g", 
+                         "00000001", "    PING", "  token ", "   dgack", "   dgac", "   DGACK" })
+        run(header);
+
+    std::mt19937 random(1);
+    const int iterations = 20000;
+    for (int i = 0; i < iterations; ++i)
+        run(mutatedStream(random));
+
+    std::cout << "OK: " << iterations << " random inputs" << std::endl;
+    return 0;
+}
+
+#endif
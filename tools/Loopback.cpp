@@ -0,0 +1,511 @@
+// Copyright (c) 2017  Mathias Roder (teuse@mailbox.org)
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Deterministic loopback stress test: a Server echoes every message back to its
+// sender while several Clients send messages of random size, verify order and
+// content of the echoes and randomly disconnect and reconnect.
+//
+// Before that, --stalled connections announce a frame of cfg::maxMessageSize and
+// send nothing else. The server's memory must not grow by more than 1 MB for each
+// of them (checked on Linux only).
+//
+// --heartbeat enables heartbeats on both sides, --byte-rate limits every client on
+// the server (the burst equals the rate). Connections must survive both.
+//
+// --datagrams 1 opens the server's datagram channel. Every client then also sends
+// datagrams, which the server echoes with sendUnreliable. Datagrams may be lost, but
+// every client must get some of its own back intact.
+//
+// --local PATH runs everything over a unix domain socket instead of TCP. A stale
+// socket file is left at PATH first, the server must replace it and remove its own
+// socket file once stopped. Datagrams need TCP.
+//
+//   NetworkLib_loopback [--seed N] [--clients N] [--messages N] [--max-size BYTES]
+//                       [--disconnect-rate P] [--stalled N] [--heartbeat MS] 
+//                       [--byte-rate BYTES] [--datagrams 0|1] [--port N] [--local PATH]
+//                       [--timeout SECONDS]
+//
+// Exits with 0 if every client got all its messages back intact and in order and
+// no connection was lost other than by an induced disconnect.
+
+#include <Network/Server.h>
+#include <Network/Client.h>
+#include <Network/Frame.h>
+
+#include <boost/asio.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+#include <sys/stat.h>
+#endif
+
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+struct Options
+{
+    unsigned seed           = 1;
+    unsigned clients        = 8;
+    unsigned messages       = 200;
+    size_t   maxSize        = 64 * 1024;
+    double   disconnectRate = 0.02;
+    unsigned stalled        = 16;
+    unsigned heartbeat      = 0;
+    double   byteRate       = 0;
+    bool     datagrams      = false;
+    unsigned port           = 47011;
+    std::string local;
+    unsigned timeout        = 120;
+    unsigned window         = 4;
+};
+
+//------------------------------------------------------------------------------
+
+network::HeartbeatConfig heartbeatConfig(const Options& options)
+{
+    network::HeartbeatConfig config;
+    config.interval    = std::chrono::milliseconds(options.heartbeat);
+    config.readTimeout = std::chrono::milliseconds(2 * options.heartbeat);
+    return config;
+}
+
+//------------------------------------------------------------------------------
+
+uint64_t checksum(const char* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ull; // FNV-1a
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ static_cast<uint8_t>(data[i])) * 1099511628211ull;
+    return hash;
+}
+
+//------------------------------------------------------------------------------
+
+class TestClient
+{
+public:
+
+    TestClient(unsigned index, const Options& options)
+    : _index(index)
+    , _options(options)
+    , _random(options.seed * 7919 + index)
+    , _client(options.port, network::ClientConfig{ heartbeatConfig(options) })
+    , _sent(0)
+    , _verified(0)
+    , _datagramsSent(0)
+    , _datagramsEchoed(0)
+    , _reconnects(0)
+    , _reconnect(false)
+    , _failed(false)
+    {
+        _client.setDataReceivedHandler([this](const std::string& data) { onEcho(data); });
+        connect();
+    }
+
+    void step()
+    {
+        _client.poll();
+        if (_failed)
+            return;
+
+        if (!_reconnect && _client.connectionState() == network::STATE_OFF)
+        {
+            std::cerr << "client " << _index << ": connection lost" << std::endl;
+            _failed = true;
+            return;
+        }
+
+        if (_reconnect)
+        {
+            reconnect();
+            return;
+        }
+
+        if (_client.connectionState() != network::STATE_CONNECTED)
+            return;
+
+        if (_options.datagrams)
+            sendDatagram();
+
+        while (_pending.size() < _options.window && _sent < _options.messages)
+        {
+            auto message = createMessage();
+            _client.send(message);
+            _pending.push_back(message);
+            ++_sent;
+        }
+    }
+
+    auto done() const -> bool     
+    { 
+        return _failed || (_verified >= _options.messages && (!_options.datagrams || _datagramsEchoed > 0)); 
+    }
+
+    auto failed()     const -> bool     { return _failed; }
+    auto verified()   const -> unsigned { return _verified; }
+    auto datagrams()  const -> unsigned { return _datagramsEchoed; }
+    auto reconnects() const -> unsigned { return _reconnects; }
+    void disconnect()                   { _client.disconnect(); }
+
+private:
+
+    std::string createMessage()
+    {
+        // Mostly small messages with a long tail up to maxSize
+        std::uniform_real_distribution<double> exponent(0.0, std::log2(static_cast<double>(_options.maxSize)));
+        auto size = std::max<size_t>(1, static_cast<size_t>(std::exp2(exponent(_random))));
+
+        std::string payload(size, '\0');
+        std::uniform_int_distribution<int> byte(0, 255);
+        for (auto& c : payload)
+            c = static_cast<char>(byte(_random));
+
+        auto message = std::to_string(_index) + ":" + std::to_string(_sent) + ":" 
+                     + std::to_string(checksum(payload.data(), payload.size())) + ":";
+        return message + payload;
+    }
+
+    // "d:<client>:<number>:<checksum>:<payload>", small enough for one datagram
+    void sendDatagram()
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (now - _lastDatagram < std::chrono::milliseconds(5))
+            return;
+
+        std::uniform_int_distribution<size_t> size(1, 512);
+        std::uniform_int_distribution<int>    byte(0, 255);
+        std::string payload(size(_random), '\0');
+        for (auto& c : payload)
+            c = static_cast<char>(byte(_random));
+
+        auto message = "d:" + std::to_string(_index) + ":" + std::to_string(_datagramsSent) + ":" 
+                     + std::to_string(checksum(payload.data(), payload.size())) + ":" + payload;
+
+        // False until the server sent the datagram token
+        if (_client.sendUnreliable(message))
+        {
+            ++_datagramsSent;
+            _lastDatagram = now;
+        }
+    }
+
+    void onDatagramEcho(const std::string& data)
+    {
+        // The separators after client, number and checksum, the payload may contain more
+        auto client  = data.find(':', 2);
+        auto number  = client == std::string::npos ? client : data.find(':', client + 1);
+        auto check   = number == std::string::npos ? number : data.find(':', number + 1);
+
+        bool intact  = check != std::string::npos
+                    && std::strtoul(data.c_str() + 2, nullptr, 10) == _index
+                    && std::strtoull(data.c_str() + number + 1, nullptr, 10) 
+                       == checksum(data.data() + check + 1, data.size() - check - 1);
+
+        if (!intact)
+        {
+            std::cerr << "client " << _index << ": corrupted datagram echo of " << data.size() << " bytes" << std::endl;
+            _failed = true;
+            return;
+        }
+        ++_datagramsEchoed;
+    }
+
+    void onEcho(const std::string& data)
+    {
+        if (data.compare(0, 2, "d:") == 0)
+        {
+            onDatagramEcho(data);
+            return;
+        }
+
+        if (_pending.empty() || data != _pending.front())
+        {
+            std::cerr << "client " << _index << ": unexpected echo of " << data.size() << " bytes"
+                      << (_pending.empty() ? " (nothing pending)" : " (out of order or corrupted)") << std::endl;
+            _failed = true;
+            return;
+        }
+
+        _pending.pop_front();
+        ++_verified;
+
+        // Not from within the handler, the client is still polling
+        std::bernoulli_distribution induceDisconnect(_options.disconnectRate);
+        if (!done() && induceDisconnect(_random))
+            _reconnect = true;
+    }
+
+    void connect()
+    {
+        if (_options.local.empty()) _client.connect("127.0.0.1");
+        else                        _client.connectLocal(_options.local);
+    }
+
+    void reconnect()
+    {
+        // Messages in flight are lost with the connection and sent again
+        _sent -= static_cast<unsigned>(_pending.size());
+        _pending.clear();
+        _reconnect = false;
+        ++_reconnects;
+
+        _client.disconnect();
+        connect();
+    }
+
+    unsigned                _index;
+    const Options&          _options;
+    std::mt19937            _random;
+    network::Client         _client;
+    std::deque<std::string> _pending;
+    unsigned                _sent;
+    unsigned                _verified;
+    unsigned                _datagramsSent;
+    unsigned                _datagramsEchoed;
+    std::chrono::steady_clock::time_point _lastDatagram;
+    unsigned                _reconnects;
+    bool                    _reconnect;
+    bool                    _failed;
+};
+
+//------------------------------------------------------------------------------
+
+// Resident memory of this process in bytes, 0 where unknown
+size_t residentBytes()
+{
+#if defined(__linux__)
+    size_t pages = 0, resident = 0;
+    std::ifstream statm("/proc/self/statm");
+    if (statm >> pages >> resident)
+        return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+
+// Connections that announce the largest frame allowed and then stall must not
+// make the server reserve memory for it
+bool checkStalledFrames(network::Server& server, const Options& options)
+{
+    if (options.stalled == 0)
+        return true;
+
+    using Protocol = boost::asio::generic::stream_protocol;
+    boost::asio::io_service ioService;
+    std::vector<std::unique_ptr<Protocol::socket>> sockets;
+
+    Protocol::endpoint endpoint(boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), options.port));
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    if (!options.local.empty())
+        endpoint = boost::asio::local::stream_protocol::endpoint(options.local);
+#endif
+
+    auto before = residentBytes();
+    auto header = network::frame::dataHeader(network::cfg::maxMessageSize);
+    for (unsigned i = 0; i < options.stalled; ++i)
+    {
+        sockets.emplace_back(new Protocol::socket(ioService));
+        sockets.back()->connect(endpoint);
+        boost::asio::write(*sockets.back(), boost::asio::buffer(header));
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (std::chrono::steady_clock::now() < deadline)
+        server.poll();
+
+    auto after = residentBytes();
+    auto limit = static_cast<size_t>(options.stalled) * 1024 * 1024;
+    sockets.clear();
+
+    if (after > before + limit)
+    {
+        std::cerr << options.stalled << " stalled frames grew the server by " 
+                  << (after - before) / (1024 * 1024) << " MB" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+
+// Bind a socket at 'path' and close it without removing the file, as a crashed
+// server would. Something already at 'path' is left alone.
+void leaveStaleSocket(const std::string& path)
+{
+    boost::asio::io_service ioService;
+    boost::asio::local::stream_protocol::acceptor acceptor(ioService);
+    boost::system::error_code ec;
+    acceptor.open(boost::asio::local::stream_protocol(), ec);
+    if (!ec) acceptor.bind(boost::asio::local::stream_protocol::endpoint(path), ec);
+}
+
+bool pathExists(const std::string& path)
+{
+    struct stat status;
+    return ::lstat(path.c_str(), &status) == 0;
+}
+
+#endif
+
+//------------------------------------------------------------------------------
+
+bool parseOptions(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string key   = argv[i];
+        auto        value = argv[i + 1];
+
+        if      (key == "--seed")            options.seed           = std::strtoul(value, nullptr, 10);
+        else if (key == "--clients")         options.clients        = std::strtoul(value, nullptr, 10);
+        else if (key == "--messages")        options.messages       = std::strtoul(value, nullptr, 10);
+        else if (key == "--max-size")        options.maxSize        = std::strtoull(value, nullptr, 10);
+        else if (key == "--disconnect-rate") options.disconnectRate = std::strtod(value, nullptr);
+        else if (key == "--stalled")         options.stalled        = std::strtoul(value, nullptr, 10);
+        else if (key == "--heartbeat")       options.heartbeat      = std::strtoul(value, nullptr, 10);
+        else if (key == "--byte-rate")       options.byteRate       = std::strtod(value, nullptr);
+        else if (key == "--datagrams")       options.datagrams      = std::strtoul(value, nullptr, 10) != 0;
+        else if (key == "--port")            options.port           = std::strtoul(value, nullptr, 10);
+        else if (key == "--local")           options.local          = value;
+        else if (key == "--timeout")         options.timeout        = std::strtoul(value, nullptr, 10);
+        else return false;
+    }
+#if !defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    if (!options.local.empty())
+        return false;
+#endif
+    return argc % 2 == 1 && options.maxSize > 0 && (options.local.empty() || !options.datagrams);
+}
+
+//------------------------------------------------------------------------------
+
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        std::cerr << "usage: NetworkLib_loopback [--seed N] [--clients N] [--messages N] [--max-size BYTES]"
+                     " [--disconnect-rate P] [--stalled N] [--heartbeat MS] [--byte-rate BYTES]"
+                     " [--datagrams 0|1] [--port N] [--local PATH] [--timeout SECONDS]" << std::endl;
+        return 2;
+    }
+
+    network::ServerConfig config;
+    config.heartbeat          = heartbeatConfig(options);
+    config.byteRatePerClient  = options.byteRate;
+    config.byteBurstPerClient = options.byteRate;
+    config.datagrams          = options.datagrams;
+
+    network::Server server(options.port, config);
+    server.setDataReceivedHandler([&server](const std::string& data, network::ClientID id) 
+    { 
+        if (data.compare(0, 2, "d:") == 0) server.sendUnreliable(data, id);
+        else                               server.send(data, id); 
+    });
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    if (!options.local.empty())
+    {
+        leaveStaleSocket(options.local);
+        server.startLocal(options.local);
+    }
+    else
+#endif
+    server.start();
+
+    if (!server.started())
+    {
+        std::cerr << "server did not start" << std::endl;
+        return 1;
+    }
+
+    bool memoryOk = checkStalledFrames(server, options);
+
+    std::vector<std::unique_ptr<TestClient>> clients;
+    for (unsigned i = 0; i < options.clients; ++i)
+        clients.emplace_back(new TestClient(i, options));
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(options.timeout);
+    auto allDone  = [&clients] 
+    { 
+        for (auto& c : clients) if (!c->done()) return false;
+        return true; 
+    };
+
+    while (!allDone() && std::chrono::steady_clock::now() < deadline)
+    {
+        for (int i = 0; i < 64; ++i)
+            server.poll();
+        for (auto& c : clients)
+            c->step();
+    }
+
+    // Every connection must be released once the clients are gone
+    for (auto& c : clients)
+        c->disconnect();
+
+    auto drainDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (server.connectionCount() > 0 && std::chrono::steady_clock::now() < drainDeadline)
+        server.poll();
+
+    bool ok = memoryOk && server.connectionCount() == 0;
+    if (server.connectionCount() > 0)
+        std::cerr << "server still has " << server.connectionCount() << " connections" << std::endl;
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    server.stop();
+    if (!options.local.empty() && pathExists(options.local))
+    {
+        std::cerr << "server left its socket file " << options.local << " behind" << std::endl;
+        ok = false;
+    }
+#endif
+
+    unsigned verified = 0, datagrams = 0, reconnects = 0;
+    for (auto& c : clients)
+    {
+        datagrams  += c->datagrams();
+        ok          = ok && c->done() && !c->failed();
+        verified   += c->verified();
+        reconnects += c->reconnects();
+    }
+
+    std::cout << (ok ? "OK" : "FAILED") << ": " << verified << " messages verified, " 
+              << (options.datagrams ? std::to_string(datagrams) + " datagram echoes, " : std::string())
+              << reconnects << " reconnects, seed " << options.seed << std::endl;
+    return ok ? 0 : 1;
+}
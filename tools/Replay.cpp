@@ -0,0 +1,348 @@
+// Copyright (c) 2017  Mathias Roder (teuse@mailbox.org)
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Replays a capture written by Server::startRecording against a running Server.
+// Every recorded client becomes one or more synthetic clients that connect,
+// send their messages and disconnect on the recorded schedule.
+//
+//   NetworkLib_replay <capture> [--host IP] [--port N] [--local PATH] 
+//                     [--speed FACTOR] [--multiply N]
+//
+// --speed 2 replays twice as fast, --speed 0 as fast as possible.
+// --multiply N starts N synthetic clients per recorded client.
+//
+// A recorded disconnect closes a client only after everything it sent is written
+// to the socket. Messages that could not be sent are reported as "not sent", 
+// including datagrams sent before the server offered its datagram channel.
+
+#include <Network/Client.h>
+#include <Network/Recorder.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+//------------------------------------------------------------------------------
+
+struct Options
+{
+    std::string capture;
+    std::string host     = "127.0.0.1";
+    unsigned    port     = 47011;
+    std::string local;
+    double      speed    = 1.0;
+    unsigned    multiply = 1;
+};
+
+//------------------------------------------------------------------------------
+
+// Read-only memory mapping of a capture file
+class Capture
+{
+public:
+
+    Capture(const std::string& path) : _data(nullptr), _size(0)
+    {
+        auto fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+
+        struct stat info;
+        if (::fstat(fd, &info) == 0 && info.st_size >= static_cast<off_t>(sizeof(network::Recorder::FileHeader)))
+        {
+            auto mapping = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED)
+            {
+                _data = static_cast<const char*>(mapping);
+                _size = static_cast<size_t>(info.st_size);
+            }
+        }
+        ::close(fd);
+    }
+
+    ~Capture() 
+    {
+        if (_data) 
+            ::munmap(const_cast<char*>(_data), _size);
+    }
+
+    auto valid() const -> bool
+    {
+        return _data && network::Recorder::validHeader(*reinterpret_cast<const network::Recorder::FileHeader*>(_data));
+    }
+
+    // Next record at 'offset', false at the end or on a truncated record
+    bool next(size_t& offset, const network::Recorder::RecordHeader*& header, const char*& payload) const
+    {
+        using network::Recorder;
+        if (offset + sizeof(Recorder::RecordHeader) > _size)
+            return false;
+
+        header  = reinterpret_cast<const Recorder::RecordHeader*>(_data + offset);
+        payload = _data + offset + sizeof(Recorder::RecordHeader);
+
+        auto end = offset + sizeof(Recorder::RecordHeader) + Recorder::paddedSize(header->size);
+        if (end > _size)
+            return false;
+
+        offset = end;
+        return true;
+    }
+
+    auto begin() const -> size_t { return sizeof(network::Recorder::FileHeader); }
+
+private:
+
+    const char* _data;
+    size_t      _size;
+};
+
+//------------------------------------------------------------------------------
+
+// One synthetic client. Messages that are due before the connection is 
+// established are kept and sent once it is.
+class Session
+{
+public:
+
+    Session(const Options& options) 
+    : _client(options.port)
+    , _dropped(0)
+    {
+        if (options.local.empty())
+            _client.connect(options.host);
+        else
+            _client.connectLocal(options.local);
+    }
+
+    void send(std::string data, bool datagram)
+    {
+        _backlog.push_back({ std::move(data), datagram });
+        flush();
+    }
+
+    void poll()
+    {
+        _client.poll();
+        flush();
+    }
+
+    // Everything sent is written to the socket, or nothing more will be
+    auto flushed() const -> bool
+    {
+        return (_backlog.empty() && _client.queuedBytes() == 0) 
+            || _client.connectionState() == network::STATE_OFF;
+    }
+
+    auto dropped()   const -> size_t { return _dropped + _backlog.size(); }
+    auto unwritten() const -> size_t { return _client.queuedBytes(); }
+
+private:
+
+    struct Message
+    {
+        std::string data;
+        bool        datagram;
+    };
+
+    void flush()
+    {
+        if (_client.connectionState() != network::STATE_CONNECTED)
+            return;
+
+        for (auto& m : _backlog)
+        {
+            if (!m.datagram)                       _client.send(m.data);
+            else if (!_client.sendUnreliable(m.data)) ++_dropped;
+        }
+        _backlog.clear();
+    }
+
+    network::Client     _client;
+    std::deque<Message> _backlog;
+    size_t              _dropped;
+};
+
+using Sessions = std::vector<std::unique_ptr<Session>>;
+
+//------------------------------------------------------------------------------
+
+bool parseOptions(int argc, char** argv, Options& options)
+{
+    if (argc < 2)
+        return false;
+
+    options.capture = argv[1];
+    for (int i = 2; i + 1 < argc; i += 2)
+    {
+        std::string key   = argv[i];
+        auto        value = argv[i + 1];
+
+        if      (key == "--host")     options.host     = value;
+        else if (key == "--port")     options.port     = std::strtoul(value, nullptr, 10);
+        else if (key == "--local")    options.local    = value;
+        else if (key == "--speed")    options.speed    = std::strtod(value, nullptr);
+        else if (key == "--multiply") options.multiply = std::strtoul(value, nullptr, 10);
+        else return false;
+    }
+    return argc % 2 == 0 && options.speed >= 0 && options.multiply > 0;
+}
+
+//------------------------------------------------------------------------------
+
+}
+
+int main(int argc, char** argv)
+{
+    using network::Recorder;
+
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        std::cerr << "usage: NetworkLib_replay <capture> [--host IP] [--port N] [--local PATH]"
+                     " [--speed FACTOR] [--multiply N]" << std::endl;
+        return 2;
+    }
+
+    Capture capture(options.capture);
+    if (!capture.valid())
+    {
+        std::cerr << "not a NetworkLib capture: " << options.capture << std::endl;
+        return 1;
+    }
+
+    size_t records = 0, messages = 0, bytes = 0, dropped = 0, unwritten = 0;
+    Clock::duration maxLag {};
+
+    // Disconnected sessions stay in 'closing' until their messages are written
+    std::unordered_map<uint64_t, Sessions> sessions;
+    Sessions                               closing;
+    auto close = [&](std::unique_ptr<Session>& s)
+    {
+        dropped   += s->dropped();
+        unwritten += s->unwritten();
+        s.reset();
+    };
+
+    auto pollAll = [&] 
+    { 
+        for (auto& s : sessions) 
+            for (auto& c : s.second) c->poll(); 
+
+        for (auto& c : closing)
+        {
+            c->poll();
+            if (c->flushed())
+                close(c);
+        }
+        closing.erase(std::remove(closing.begin(), closing.end(), nullptr), closing.end());
+    };
+
+    auto sessionsOf = [&](uint64_t clientID) -> Sessions&
+    {
+        auto& list = sessions[clientID];
+        while (list.size() < options.multiply)
+            list.emplace_back(new Session(options));
+        return list;
+    };
+
+    auto start  = Clock::now();
+    auto offset = capture.begin();
+    const Recorder::RecordHeader* header = nullptr;
+    const char*                   payload = nullptr;
+
+    while (capture.next(offset, header, payload))
+    {
+        ++records;
+
+        // Wait for the recorded point in time, scaled by the replay speed
+        if (options.speed > 0)
+        {
+            auto due = start + std::chrono::duration_cast<Clock::duration>(
+                                   std::chrono::nanoseconds(header->timestamp) / options.speed);
+            while (Clock::now() < due)
+            {
+                pollAll();
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+            maxLag = std::max(maxLag, Clock::now() - due);
+        }
+
+        switch (header->event)
+        {
+        case Recorder::EVENT_CONNECT:
+            sessionsOf(header->clientID);
+            break;
+
+        case Recorder::EVENT_DISCONNECT:
+            for (auto& s : sessions[header->clientID]) 
+                closing.push_back(std::move(s));
+            sessions.erase(header->clientID);
+            break;
+
+        case Recorder::EVENT_DATA:
+        case Recorder::EVENT_DATAGRAM:
+            // Clients that were already connected when the capture started appear with their first message
+            for (auto& s : sessionsOf(header->clientID))
+            {
+                s->send(std::string(payload, header->size), header->event == Recorder::EVENT_DATAGRAM);
+                ++messages;
+                bytes += header->size;
+            }
+            break;
+        }
+
+        pollAll();
+    }
+
+    // Clients still connected at the end of the capture are closed like the others,
+    // giving those that are still connecting the chance to send their backlog
+    for (auto& s : sessions)
+        for (auto& c : s.second) 
+            closing.push_back(std::move(c));
+    sessions.clear();
+
+    auto drainDeadline = Clock::now() + std::chrono::seconds(5);
+    while (!closing.empty() && Clock::now() < drainDeadline)
+        pollAll();
+
+    for (auto& c : closing)
+        close(c);
+    closing.clear();
+
+    auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    std::cout << records << " records, " << messages << " messages (" << bytes << " bytes) sent in " 
+              << elapsed << "s, " << dropped << " not sent, " << unwritten << " bytes not written, max lag " 
+              << std::chrono::duration<double, std::milli>(maxLag).count() << "ms" << std::endl;
+    return 0;
+}